@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2015 - 2016 Rockchip Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include "bitstream_arena.h"
+
+void
+bitstream_arena_init(bitstream_arena_p arena, dma_memory_cache_p cache)
+{
+    arena->chunks = NULL;
+    arena->num_chunks = 0;
+    arena->max_chunks = 0;
+    arena->size = 0;
+    arena->capacity = 0;
+    arena->slices = NULL;
+    arena->num_slices = 0;
+    arena->max_slices = 0;
+    arena->memory = NULL;
+    arena->num_memory = 0;
+    arena->max_memory = 0;
+    arena->cache = cache;
+}
+
+void
+bitstream_arena_reset(bitstream_arena_p arena)
+{
+    size_t capacity = 0;
+
+    while (arena->num_memory)
+        dma_memory_free(arena->cache, &arena->memory[--arena->num_memory]);
+
+    /* A picture that needed several chunks gets one as large as all of them next time */
+    if (arena->num_chunks > 1) {
+        while (arena->num_chunks) {
+            capacity += arena->chunks[--arena->num_chunks].capacity;
+            free(arena->chunks[arena->num_chunks].data);
+        }
+        arena->capacity = capacity;
+    } else if (arena->num_chunks) {
+        arena->chunks[0].size = 0;
+    }
+    arena->size = 0;
+    arena->num_slices = 0;
+}
+
+/*
+ * Makes room for one more slice entry.
+ * Return 0 on success, -1 on error
+ */
+static int
+bitstream_arena_reserve_slice(bitstream_arena_p arena)
+{
+    if (arena->num_slices == arena->max_slices) {
+        int max_slices = arena->max_slices ? arena->max_slices * 2 : BITSTREAM_ARENA_MIN_SLICES;
+        struct bitstream_slice *slices;
+
+        slices = realloc(arena->slices, max_slices * sizeof(*slices));
+        if (NULL == slices)
+            return -1;
+        arena->slices = slices;
+        arena->max_slices = max_slices;
+    }
+    return 0;
+}
+
+/*
+ * Returns a chunk with room for size more bytes. Data that doesn't fit
+ * the last chunk goes into a new one at least twice its size, the
+ * chunks before stay where they are.
+ * Returns NULL on error
+ */
+static struct bitstream_chunk *
+bitstream_arena_reserve_data(bitstream_arena_p arena, size_t size)
+{
+    struct bitstream_chunk *chunk = arena->num_chunks ? &arena->chunks[arena->num_chunks - 1] : NULL;
+    size_t capacity;
+    void *data;
+
+    if (chunk && chunk->size + size <= chunk->capacity)
+        return chunk;
+
+    if (chunk)
+        capacity = chunk->capacity * 2;
+    else
+        capacity = arena->capacity > BITSTREAM_ARENA_MIN_SIZE ? arena->capacity : BITSTREAM_ARENA_MIN_SIZE;
+    while (capacity < size)
+        capacity *= 2;
+
+    if (arena->num_chunks == arena->max_chunks) {
+        int max_chunks = arena->max_chunks ? arena->max_chunks * 2 : BITSTREAM_ARENA_MIN_CHUNKS;
+        struct bitstream_chunk *chunks;
+
+        chunks = realloc(arena->chunks, max_chunks * sizeof(*chunks));
+        if (NULL == chunks)
+            return NULL;
+        arena->chunks = chunks;
+        arena->max_chunks = max_chunks;
+    }
+
+    if (posix_memalign(&data, BITSTREAM_ARENA_ALIGNMENT, capacity + BITSTREAM_ARENA_PADDING))
+        return NULL;
+    chunk = &arena->chunks[arena->num_chunks++];
+    chunk->data = data;
+    chunk->size = 0;
+    chunk->capacity = capacity;
+    arena->capacity = capacity;
+    return chunk;
+}
+
+int
+bitstream_arena_append(bitstream_arena_p arena, const void *data, size_t size)
+{
+    struct bitstream_slice *slice;
+    struct bitstream_chunk *chunk;
+
+    if (-1 == bitstream_arena_reserve_slice(arena))
+        return -1;
+    chunk = bitstream_arena_reserve_data(arena, size);
+    if (NULL == chunk)
+        return -1;
+
+    slice = &arena->slices[arena->num_slices++];
+    slice->offset = chunk->size;
+    slice->size = size;
+    slice->chunk = chunk - arena->chunks;
+    slice->memory = -1;
+
+    memcpy(chunk->data + chunk->size, data, size);
+    chunk->size += size;
+    memset(chunk->data + chunk->size, 0, BITSTREAM_ARENA_PADDING);
+    arena->size += size;
+    return 0;
+}
+
+int
+bitstream_arena_attach(bitstream_arena_p arena, dma_memory_p mem, size_t size)
+{
+    struct bitstream_slice *slice;
+
+    if (-1 == bitstream_arena_reserve_slice(arena))
+        return -1;
+
+    if (arena->num_memory == arena->max_memory) {
+        int max_memory = arena->max_memory ? arena->max_memory * 2 : BITSTREAM_ARENA_MIN_SLICES;
+        struct dma_memory *memory;
+
+        memory = realloc(arena->memory, max_memory * sizeof(*memory));
+        if (NULL == memory)
+            return -1;
+        arena->memory = memory;
+        arena->max_memory = max_memory;
+    }
+
+    slice = &arena->slices[arena->num_slices++];
+    slice->offset = 0;
+    slice->size = size;
+    slice->chunk = -1;
+    slice->memory = arena->num_memory;
+    arena->memory[arena->num_memory++] = *mem;
+    return 0;
+}
+
+void
+bitstream_arena_destroy(bitstream_arena_p arena)
+{
+    bitstream_arena_reset(arena);
+    if (arena->num_chunks)
+        free(arena->chunks[0].data);
+    free(arena->chunks);
+    free(arena->slices);
+    free(arena->memory);
+    bitstream_arena_init(arena, arena->cache);
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2015 - 2016 Rockchip Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef BITSTREAM_ARENA_H
+#define BITSTREAM_ARENA_H
+
+#include <stddef.h>
+#include "dma_memory.h"
+
+/* Storage alignment, and zeroed bytes kept past the end of the data */
+#define BITSTREAM_ARENA_ALIGNMENT   64
+#define BITSTREAM_ARENA_PADDING     64
+
+#define BITSTREAM_ARENA_MIN_SIZE    (64 * 1024)
+#define BITSTREAM_ARENA_MIN_SLICES  32
+#define BITSTREAM_ARENA_MIN_CHUNKS  4
+
+typedef struct bitstream_arena *bitstream_arena_p;
+
+struct bitstream_slice {
+    unsigned int offset;
+    unsigned int size;
+    int chunk;          /* index into chunks[] if in the arena data */
+    int memory;         /* index into memory[], -1 if in the arena data */
+};
+
+struct bitstream_chunk {
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+};
+
+/*
+ * The slice data of one picture, concatenated in submission order, plus
+ * the offset and size of every slice within it.
+ * Appended data stays where it is until the next reset: a picture that
+ * outgrows its storage continues in a further chunk, so a decoder can
+ * read the slices it has while later ones are appended. Reset merges
+ * the chunks into one, storage is kept across pictures and only grows.
+ * Slices that already sit in device-visible memory are not copied; the
+ * arena takes over their dma_memory instead and the slice refers to it.
+ */
+struct bitstream_arena {
+    struct bitstream_chunk *chunks;
+    int num_chunks;
+    int max_chunks;
+    size_t size;        /* bytes appended since the last reset */
+    size_t capacity;    /* of the chunk the next picture starts in */
+    struct bitstream_slice *slices;
+    int num_slices;
+    int max_slices;
+    struct dma_memory *memory;
+    int num_memory;
+    int max_memory;
+    dma_memory_cache_p cache;
+};
+
+/*
+ * Attached memory is released to cache.
+ */
+void
+bitstream_arena_init(bitstream_arena_p arena, dma_memory_cache_p cache);
+
+/*
+ * Empties the arena for the next picture, keeping its storage and
+ * releasing attached memory. Data of the previous picture may move.
+ */
+void
+bitstream_arena_reset(bitstream_arena_p arena);
+
+/*
+ * Appends one slice. Data appended before is not moved.
+ * Return 0 on success, -1 on error
+ */
+int
+bitstream_arena_append(bitstream_arena_p arena, const void *data, size_t size);
+
+/*
+ * Appends one slice held in device-visible memory, without copying.
+ * The arena owns mem from now on.
+ * Return 0 on success, -1 on error
+ */
+int
+bitstream_arena_attach(bitstream_arena_p arena, dma_memory_p mem, size_t size);
+
+/*
+ * Data of slice index, which is in the arena data
+ */
+static inline const unsigned char *
+bitstream_arena_slice_data(const struct bitstream_arena *arena, int index)
+{
+    const struct bitstream_slice *slice = &arena->slices[index];
+
+    return arena->chunks[slice->chunk].data + slice->offset;
+}
+
+void
+bitstream_arena_destroy(bitstream_arena_p arena);
+
+#endif /* BITSTREAM_ARENA_H */
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2015 - 2016 Rockchip Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "buffer_pool.h"
+
+/*
+ * Returns the size class of a request, or -1 if it is too large to pool
+ */
+static int
+buffer_pool_class(size_t size)
+{
+    int class = 0;
+
+    while (((size_t)1 << (class + BUFFER_POOL_MIN_SHIFT)) < size) {
+        if (++class == BUFFER_POOL_NUM_CLASSES)
+            return -1;
+    }
+    return class;
+}
+
+static inline size_t
+buffer_pool_class_size(int class)
+{
+    return (size_t)1 << (class + BUFFER_POOL_MIN_SHIFT);
+}
+
+/*
+ * Return 0 on success, -1 on error
+ */
+int
+buffer_pool_init(buffer_pool_p pool, size_t max_bytes)
+{
+    if (pthread_mutex_init(&pool->mutex, NULL))
+        return -1;
+    pool->max_bytes = max_bytes;
+    pool->cached_bytes = 0;
+    memset(pool->free_list, 0, sizeof(pool->free_list));
+    pool->hits = 0;
+    pool->misses = 0;
+    return 0;
+}
+
+void *
+buffer_pool_alloc(buffer_pool_p pool, int type, size_t size)
+{
+    int class = buffer_pool_class(size);
+    size_t block_size = class < 0 ? size : buffer_pool_class_size(class);
+    void **head;
+    void *data = NULL;
+
+    type %= BUFFER_POOL_MAX_TYPES;
+
+    pthread_mutex_lock(&pool->mutex);
+    if (class >= 0 && pool->free_list[type][class]) {
+        head = &pool->free_list[type][class];
+        data = *head;
+        *head = *(void **) data;
+        pool->cached_bytes -= block_size;
+        pool->hits++;
+    } else {
+        pool->misses++;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (NULL == data) {
+        if (posix_memalign(&data, BUFFER_POOL_ALIGNMENT, block_size + BUFFER_POOL_PADDING))
+            return NULL;
+    }
+
+    /* Only the padding is cleared; the payload is the caller's to fill */
+    memset(data + size, 0, BUFFER_POOL_PADDING);
+    return data;
+}
+
+void
+buffer_pool_free(buffer_pool_p pool, int type, size_t size, void *data)
+{
+    int class = buffer_pool_class(size);
+    size_t block_size;
+
+    if (NULL == data)
+        return;
+
+    type %= BUFFER_POOL_MAX_TYPES;
+
+    if (class >= 0) {
+        block_size = buffer_pool_class_size(class);
+
+        pthread_mutex_lock(&pool->mutex);
+        if (pool->cached_bytes + block_size <= pool->max_bytes) {
+            /* The link lives in the first word of the cached block */
+            *(void **) data = pool->free_list[type][class];
+            pool->free_list[type][class] = data;
+            pool->cached_bytes += block_size;
+            data = NULL;
+        }
+        pthread_mutex_unlock(&pool->mutex);
+    }
+
+    free(data);
+}
+
+void
+buffer_pool_destroy(buffer_pool_p pool)
+{
+    int type, class;
+    void *data, *next;
+
+    for (type = 0; type < BUFFER_POOL_MAX_TYPES; type++) {
+        for (class = 0; class < BUFFER_POOL_NUM_CLASSES; class++) {
+            for (data = pool->free_list[type][class]; data; data = next) {
+                next = *(void **) data;
+                free(data);
+            }
+            pool->free_list[type][class] = NULL;
+        }
+    }
+    pool->cached_bytes = 0;
+    pthread_mutex_destroy(&pool->mutex);
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2015 - 2016 Rockchip Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+/* Every block starts on this boundary */
+#define BUFFER_POOL_ALIGNMENT   64
+/* Zeroed bytes past the requested size, so SIMD readers may over-read */
+#define BUFFER_POOL_PADDING     64
+
+/* Size classes are powers of two from 64 bytes to 32 MB */
+#define BUFFER_POOL_MIN_SHIFT   6
+#define BUFFER_POOL_NUM_CLASSES 20
+
+/* Free lists are kept per buffer type; larger types share slots */
+#define BUFFER_POOL_MAX_TYPES   64
+
+typedef struct buffer_pool *buffer_pool_p;
+
+struct buffer_pool {
+    pthread_mutex_t mutex;
+    size_t max_bytes;
+    size_t cached_bytes;
+    void *free_list[BUFFER_POOL_MAX_TYPES][BUFFER_POOL_NUM_CLASSES];
+    unsigned long hits;
+    unsigned long misses;
+};
+
+/*
+ * At most max_bytes of released blocks are kept for reuse.
+ * Return 0 on success, -1 on error
+ */
+int
+buffer_pool_init(buffer_pool_p pool, size_t max_bytes);
+
+/*
+ * Returns a block of at least size bytes for the given buffer type,
+ * recycled if possible, or NULL if out of memory.
+ */
+void *
+buffer_pool_alloc(buffer_pool_p pool, int type, size_t size);
+
+/*
+ * Returns a block obtained with the same type and size to the pool.
+ */
+void
+buffer_pool_free(buffer_pool_p pool, int type, size_t size, void *data);
+
+/*
+ * Releases all cached blocks.
+ */
+void
+buffer_pool_destroy(buffer_pool_p pool);
+
+#endif /* BUFFER_POOL_H */
@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2015 - 2016 Rockchip Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "copy_engine.h"
+
+/*
+ * Runs the next band of job, dropping the job from the queue once its
+ * last band is taken.
+ * Called and returns with the mutex held.
+ */
+static void
+copy_engine_run_band(copy_engine_p engine, copy_engine_job_p job)
+{
+    copy_engine_job_p *link;
+    unsigned int first, count;
+
+    first = job->next_band++ * job->band_rows;
+    if (job->next_band == job->num_bands) {
+        for (link = &engine->jobs; *link != job; link = &(*link)->next)
+            ;
+        *link = job->next;
+    }
+    pthread_mutex_unlock(&engine->mutex);
+
+    count = job->rows - first < job->band_rows ? job->rows - first : job->band_rows;
+    job->func(job->arg, first, count);
+
+    pthread_mutex_lock(&engine->mutex);
+    if (++job->bands_done == job->num_bands)
+        pthread_cond_broadcast(&engine->done_cond);
+}
+
+static void *
+copy_engine_worker(void *data)
+{
+    copy_engine_p engine = data;
+
+    pthread_mutex_lock(&engine->mutex);
+    for (;;) {
+        while (!engine->quit && NULL == engine->jobs)
+            pthread_cond_wait(&engine->work_cond, &engine->mutex);
+        if (engine->quit)
+            break;
+        copy_engine_run_band(engine, engine->jobs);
+    }
+    pthread_mutex_unlock(&engine->mutex);
+    return NULL;
+}
+
+/*
+ * Return 0 on success, -1 on error
+ */
+int
+copy_engine_init(copy_engine_p engine, int num_threads)
+{
+    int i;
+
+    if (num_threads < 1)
+        num_threads = 1;
+    if (num_threads > COPY_ENGINE_MAX_THREADS)
+        num_threads = COPY_ENGINE_MAX_THREADS;
+
+    if (pthread_mutex_init(&engine->mutex, NULL) ||
+        pthread_cond_init(&engine->work_cond, NULL) ||
+        pthread_cond_init(&engine->done_cond, NULL))
+        return -1;
+
+    engine->quit = 0;
+    engine->jobs = NULL;
+
+    /* The caller is thread 0; run with fewer workers if creation fails */
+    engine->num_threads = 1;
+    for (i = 1; i < num_threads; i++) {
+        if (pthread_create(&engine->threads[i], NULL, copy_engine_worker, engine))
+            break;
+        engine->num_threads++;
+    }
+    return 0;
+}
+
+void
+copy_engine_run(copy_engine_p engine, copy_engine_func func, void *arg,
+                unsigned int rows, unsigned int row_bytes)
+{
+    struct copy_engine_job job;
+    copy_engine_job_p *link;
+    unsigned int band_rows;
+
+    if (0 == rows)
+        return;
+
+    if (engine->num_threads == 1 || (unsigned long)rows * row_bytes < COPY_ENGINE_MIN_BYTES) {
+        func(arg, 0, rows);
+        return;
+    }
+
+    band_rows = row_bytes ? COPY_ENGINE_BAND_BYTES / row_bytes : rows;
+    band_rows = (band_rows + 1) & ~1u;
+    if (band_rows < 2)
+        band_rows = 2;
+
+    job.next = NULL;
+    job.func = func;
+    job.arg = arg;
+    job.rows = rows;
+    job.band_rows = band_rows;
+    job.next_band = 0;
+    job.num_bands = (rows + band_rows - 1) / band_rows;
+    job.bands_done = 0;
+
+    pthread_mutex_lock(&engine->mutex);
+    for (link = &engine->jobs; *link; link = &(*link)->next)
+        ;
+    *link = &job;
+    pthread_cond_broadcast(&engine->work_cond);
+
+    while (job.next_band < job.num_bands)
+        copy_engine_run_band(engine, &job);
+    while (job.bands_done < job.num_bands)
+        pthread_cond_wait(&engine->done_cond, &engine->mutex);
+    pthread_mutex_unlock(&engine->mutex);
+}
+
+void
+copy_engine_destroy(copy_engine_p engine)
+{
+    int i;
+
+    pthread_mutex_lock(&engine->mutex);
+    engine->quit = 1;
+    pthread_cond_broadcast(&engine->work_cond);
+    pthread_mutex_unlock(&engine->mutex);
+
+    for (i = 1; i < engine->num_threads; i++)
+        pthread_join(engine->threads[i], NULL);
+
+    pthread_cond_destroy(&engine->done_cond);
+    pthread_cond_destroy(&engine->work_cond);
+    pthread_mutex_destroy(&engine->mutex);
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2015 - 2016 Rockchip Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef COPY_ENGINE_H
+#define COPY_ENGINE_H
+
+#include <pthread.h>
+
+/* Upper bound on workers, including the calling thread */
+#define COPY_ENGINE_MAX_THREADS 16
+/* Bands are sized to stay resident in a typical L2 */
+#define COPY_ENGINE_BAND_BYTES  (256 * 1024)
+/* Transfers smaller than this run on the calling thread alone */
+#define COPY_ENGINE_MIN_BYTES   (1024 * 1024)
+
+typedef struct copy_engine *copy_engine_p;
+typedef struct copy_engine_job *copy_engine_job_p;
+
+/*
+ * Processes rows [first_row, first_row + num_rows) of a transfer
+ */
+typedef void (*copy_engine_func)(void *arg, unsigned int first_row, unsigned int num_rows);
+
+/*
+ * One transfer, owned by the copy_engine_run call that started it
+ */
+struct copy_engine_job {
+    copy_engine_job_p next;
+    copy_engine_func func;
+    void *arg;
+    unsigned int rows;
+    unsigned int band_rows;
+    unsigned int next_band;
+    unsigned int num_bands;
+    unsigned int bands_done;
+};
+
+/*
+ * Splits frame sized transfers into horizontal bands and runs them on a
+ * small pool of workers. The calling thread takes bands too, so a pool
+ * of n threads starts n - 1 workers. Transfers of several callers, say
+ * GetImage on two contexts, run at once: each caller works through its
+ * own bands while the workers help the oldest transfer first.
+ */
+struct copy_engine {
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cond;
+    pthread_cond_t done_cond;
+    pthread_t threads[COPY_ENGINE_MAX_THREADS];
+    int num_threads;
+    int quit;
+    copy_engine_job_p jobs;         /* transfers with bands left, oldest first */
+};
+
+/*
+ * Return 0 on success, -1 on error
+ */
+int
+copy_engine_init(copy_engine_p engine, int num_threads);
+
+/*
+ * Runs func over rows rows of row_bytes each and waits for all bands.
+ * Bands are an even number of rows, so 4:2:0 chroma splits cleanly.
+ */
+void
+copy_engine_run(copy_engine_p engine, copy_engine_func func, void *arg,
+                unsigned int rows, unsigned int row_bytes);
+
+/*
+ * Stops and joins the workers.
+ */
+void
+copy_engine_destroy(copy_engine_p engine);
+
+#endif /* COPY_ENGINE_H */
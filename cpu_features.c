@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2015 - 2016 Rockchip Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <string.h>
+#include "cpu_features.h"
+
+#if defined(__aarch64__) || defined(__arm__)
+#include <sys/auxv.h>
+#endif
+
+/* From the kernel's asm/hwcap.h, for older C libraries */
+#if defined(__aarch64__)
+#ifndef HWCAP_ASIMD
+#define HWCAP_ASIMD     (1 << 1)
+#endif
+#ifndef HWCAP_SVE
+#define HWCAP_SVE       (1 << 22)
+#endif
+#elif defined(__arm__)
+#ifndef HWCAP_NEON
+#define HWCAP_NEON      (1 << 12)
+#endif
+#endif
+
+/* Levels from best to worst, each with the features it implies */
+static const struct {
+    const char *name;
+    unsigned int features;
+} cpu_feature_levels[] = {
+    { "avx2",   CPU_FEATURE_AVX2 | CPU_FEATURE_SSE4_1 | CPU_FEATURE_SSSE3 | CPU_FEATURE_SSE2 },
+    { "sse4.1", CPU_FEATURE_SSE4_1 | CPU_FEATURE_SSSE3 | CPU_FEATURE_SSE2 },
+    { "ssse3",  CPU_FEATURE_SSSE3 | CPU_FEATURE_SSE2 },
+    { "sse2",   CPU_FEATURE_SSE2 },
+    { "sve",    CPU_FEATURE_SVE | CPU_FEATURE_NEON },
+    { "neon",   CPU_FEATURE_NEON },
+    { "scalar", 0 },
+};
+
+#define CPU_FEATURE_LEVELS  (sizeof(cpu_feature_levels) / sizeof(cpu_feature_levels[0]))
+
+unsigned int
+cpu_features_probe(void)
+{
+    unsigned int features = 0;
+
+#if defined(__x86_64__) || defined(__i386__)
+    /* Checks OS support of the AVX state too */
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+        features |= CPU_FEATURE_SSE2;
+    if (__builtin_cpu_supports("ssse3"))
+        features |= CPU_FEATURE_SSSE3;
+    if (__builtin_cpu_supports("sse4.1"))
+        features |= CPU_FEATURE_SSE4_1;
+    if (__builtin_cpu_supports("avx2"))
+        features |= CPU_FEATURE_AVX2;
+#elif defined(__aarch64__)
+    unsigned long hwcap = getauxval(AT_HWCAP);
+
+    if (hwcap & HWCAP_ASIMD)
+        features |= CPU_FEATURE_NEON;
+    if (hwcap & HWCAP_SVE)
+        features |= CPU_FEATURE_SVE;
+#elif defined(__arm__)
+    if (getauxval(AT_HWCAP) & HWCAP_NEON)
+        features |= CPU_FEATURE_NEON;
+#endif
+
+    return features;
+}
+
+int
+cpu_features_limit(unsigned int *features, const char *name)
+{
+    unsigned int i;
+
+    for (i = 0; i < CPU_FEATURE_LEVELS; i++) {
+        if (0 == strcmp(cpu_feature_levels[i].name, name)) {
+            *features &= cpu_feature_levels[i].features;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char *
+cpu_features_name(unsigned int features)
+{
+    unsigned int i;
+
+    for (i = 0; i < CPU_FEATURE_LEVELS - 1; i++) {
+        if ((features & cpu_feature_levels[i].features) == cpu_feature_levels[i].features)
+            return cpu_feature_levels[i].name;
+    }
+    return "scalar";
+}
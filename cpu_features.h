@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2015 - 2016 Rockchip Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+/* Vector extensions the pixel kernels have variants for */
+#define CPU_FEATURE_SSE2        (1 << 0)
+#define CPU_FEATURE_SSSE3       (1 << 1)
+#define CPU_FEATURE_SSE4_1      (1 << 2)
+#define CPU_FEATURE_AVX2        (1 << 3)
+#define CPU_FEATURE_NEON        (1 << 4)
+#define CPU_FEATURE_SVE         (1 << 5)
+
+/*
+ * Returns the CPU_FEATURE_* bits the running CPU and kernel support
+ */
+unsigned int
+cpu_features_probe(void);
+
+/*
+ * Caps features at a named level: "scalar", "sse2", "ssse3", "sse4.1",
+ * "avx2", "neon" or "sve". A level keeps the features below it, as the
+ * hardware that has it does.
+ * Return 0 on success, -1 on an unknown name
+ */
+int
+cpu_features_limit(unsigned int *features, const char *name);
+
+/*
+ * Name of the best level in features, "scalar" if none
+ */
+const char *
+cpu_features_name(unsigned int features);
+
+#endif /* CPU_FEATURES_H */
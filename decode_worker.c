@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2015 - 2016 Rockchip Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "decode_worker.h"
+
+/*
+ * A side that found the ring empty or full flags itself waiting, then
+ * checks the other side's index again before it sleeps. The other side
+ * publishes its index before it reads the flag, both sequentially
+ * consistent, so one of the two always sees the other and no wakeup is
+ * lost.
+ */
+static void
+decode_worker_wake(decode_worker_p worker, int *waiting)
+{
+    if (__atomic_load_n(waiting, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&worker->mutex);
+        pthread_cond_broadcast(&worker->cond);
+        pthread_mutex_unlock(&worker->mutex);
+    }
+}
+
+static void *
+decode_worker_thread(void *data)
+{
+    decode_worker_p worker = data;
+    unsigned int head = 0;
+
+    for (;;) {
+        if (head == __atomic_load_n(&worker->tail, __ATOMIC_ACQUIRE)) {
+            int quit;
+
+            pthread_mutex_lock(&worker->mutex);
+            __atomic_store_n(&worker->consumer_waiting, 1, __ATOMIC_SEQ_CST);
+            while (!worker->quit && head == __atomic_load_n(&worker->tail, __ATOMIC_SEQ_CST))
+                pthread_cond_wait(&worker->cond, &worker->mutex);
+            __atomic_store_n(&worker->consumer_waiting, 0, __ATOMIC_RELAXED);
+            quit = worker->quit && head == __atomic_load_n(&worker->tail, __ATOMIC_ACQUIRE);
+            pthread_mutex_unlock(&worker->mutex);
+            if (quit)
+                break;
+            continue;
+        }
+
+        worker->func(worker->arg, head % worker->depth);
+
+        /* The slot is free for the producer again */
+        __atomic_store_n(&worker->head, ++head, __ATOMIC_SEQ_CST);
+        decode_worker_wake(worker, &worker->producer_waiting);
+    }
+    return NULL;
+}
+
+/*
+ * Return 0 on success, -1 on error
+ */
+int
+decode_worker_init(decode_worker_p worker, unsigned int depth,
+                   decode_worker_func func, void *arg)
+{
+    if (depth < 1 || depth > DECODE_WORKER_MAX_DEPTH)
+        return -1;
+
+    worker->tail = 0;
+    worker->producer_waiting = 0;
+    worker->submitted = 0;
+    worker->depth_sum = 0;
+    worker->stalls = 0;
+    worker->max_depth = 0;
+    worker->head = 0;
+    worker->consumer_waiting = 0;
+    worker->depth = depth;
+    worker->quit = 0;
+    worker->func = func;
+    worker->arg = arg;
+
+    if (pthread_mutex_init(&worker->mutex, NULL))
+        return -1;
+    if (pthread_cond_init(&worker->cond, NULL)) {
+        pthread_mutex_destroy(&worker->mutex);
+        return -1;
+    }
+    if (pthread_create(&worker->thread, NULL, decode_worker_thread, worker)) {
+        pthread_cond_destroy(&worker->cond);
+        pthread_mutex_destroy(&worker->mutex);
+        return -1;
+    }
+    return 0;
+}
+
+unsigned int
+decode_worker_acquire(decode_worker_p worker)
+{
+    const unsigned int tail = worker->tail;
+
+    if (tail - __atomic_load_n(&worker->head, __ATOMIC_ACQUIRE) == worker->depth) {
+        worker->stalls++;
+        pthread_mutex_lock(&worker->mutex);
+        __atomic_store_n(&worker->producer_waiting, 1, __ATOMIC_SEQ_CST);
+        while (tail - __atomic_load_n(&worker->head, __ATOMIC_SEQ_CST) == worker->depth)
+            pthread_cond_wait(&worker->cond, &worker->mutex);
+        __atomic_store_n(&worker->producer_waiting, 0, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&worker->mutex);
+    }
+    return tail % worker->depth;
+}
+
+void
+decode_worker_submit(decode_worker_p worker)
+{
+    const unsigned int tail = worker->tail + 1;
+    const unsigned int in_flight = tail - __atomic_load_n(&worker->head, __ATOMIC_RELAXED);
+
+    worker->submitted++;
+    worker->depth_sum += in_flight;
+    if (in_flight > worker->max_depth)
+        worker->max_depth = in_flight;
+
+    __atomic_store_n(&worker->tail, tail, __ATOMIC_SEQ_CST);
+    decode_worker_wake(worker, &worker->consumer_waiting);
+}
+
+void
+decode_worker_lock(decode_worker_p worker)
+{
+    pthread_mutex_lock(&worker->mutex);
+}
+
+void
+decode_worker_unlock(decode_worker_p worker)
+{
+    pthread_mutex_unlock(&worker->mutex);
+}
+
+void
+decode_worker_notify(decode_worker_p worker)
+{
+    pthread_cond_broadcast(&worker->cond);
+}
+
+void
+decode_worker_wait(decode_worker_p worker)
+{
+    pthread_cond_wait(&worker->cond, &worker->mutex);
+}
+
+void
+decode_worker_destroy(decode_worker_p worker)
+{
+    /* The thread empties the ring before it sees quit */
+    pthread_mutex_lock(&worker->mutex);
+    worker->quit = 1;
+    pthread_cond_broadcast(&worker->cond);
+    pthread_mutex_unlock(&worker->mutex);
+
+    pthread_join(worker->thread, NULL);
+
+    pthread_cond_destroy(&worker->cond);
+    pthread_mutex_destroy(&worker->mutex);
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2015 - 2016 Rockchip Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef DECODE_WORKER_H
+#define DECODE_WORKER_H
+
+#include <pthread.h>
+
+/* Upper bound on pictures in flight per context */
+#define DECODE_WORKER_MAX_DEPTH     16
+
+#define DECODE_WORKER_CACHE_LINE    64
+
+typedef struct decode_worker *decode_worker_p;
+
+/*
+ * Decodes the picture in slot, called on the worker thread
+ */
+typedef void (*decode_worker_func)(void *arg, unsigned int slot);
+
+/*
+ * Backend thread of a decoding context, fed through a ring of depth
+ * picture slots that the caller owns. One producer fills and submits
+ * slots in order, the worker decodes them in the same order and hands
+ * each slot back once done. Ring indices are exchanged lock free; the
+ * mutex is only taken to sleep when the ring is empty or full, and to
+ * wake the side that sleeps.
+ */
+struct decode_worker {
+    /* Producer */
+    unsigned int tail;              /* slots submitted */
+    int producer_waiting;
+    unsigned long submitted;        /* statistics */
+    unsigned long depth_sum;        /* pictures in flight, summed over submissions */
+    unsigned long stalls;           /* acquires that waited for a free slot */
+    unsigned int max_depth;
+    unsigned char producer_pad[DECODE_WORKER_CACHE_LINE];
+    /* Consumer */
+    unsigned int head;              /* slots decoded */
+    int consumer_waiting;
+    unsigned char consumer_pad[DECODE_WORKER_CACHE_LINE];
+    /* Set at creation */
+    unsigned int depth;
+    int quit;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_t thread;
+    decode_worker_func func;
+    void *arg;
+};
+
+/*
+ * Return 0 on success, -1 on error
+ */
+int
+decode_worker_init(decode_worker_p worker, unsigned int depth,
+                   decode_worker_func func, void *arg);
+
+/*
+ * Returns the slot the next submission goes to, waiting while all
+ * depth slots are in flight. Acquiring again before submitting returns
+ * the same slot.
+ */
+unsigned int
+decode_worker_acquire(decode_worker_p worker);
+
+/*
+ * Queues the acquired slot behind the ones already submitted.
+ */
+void
+decode_worker_submit(decode_worker_p worker);
+
+/*
+ * A slot may also be submitted before its data is complete and filled
+ * while the worker decodes it. Producer and worker then touch the slot
+ * only with the lock held; the producer wakes the worker with
+ * decode_worker_notify() once there is more, the worker sleeps for it
+ * in decode_worker_wait().
+ */
+void
+decode_worker_lock(decode_worker_p worker);
+
+void
+decode_worker_unlock(decode_worker_p worker);
+
+void
+decode_worker_notify(decode_worker_p worker);
+
+void
+decode_worker_wait(decode_worker_p worker);
+
+/*
+ * Decodes the slots still queued, then stops and joins the thread.
+ */
+void
+decode_worker_destroy(decode_worker_p worker);
+
+#endif /* DECODE_WORKER_H */
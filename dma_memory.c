@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2015 - 2016 Rockchip Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "dma_memory.h"
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC             0x0001U
+#define MFD_ALLOW_SEALING       0x0002U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS             (1024 + 9)
+#define F_SEAL_SHRINK           0x0002
+#endif
+
+/* From linux/udmabuf.h, which older kernel headers lack */
+#ifndef UDMABUF_CREATE
+struct udmabuf_create {
+    uint32_t memfd;
+    uint32_t flags;
+    uint64_t offset;
+    uint64_t size;
+};
+#define UDMABUF_FLAGS_CLOEXEC   0x01
+#define UDMABUF_CREATE          _IOW('u', 0x42, struct udmabuf_create)
+#endif
+
+static pthread_once_t udmabuf_once = PTHREAD_ONCE_INIT;
+static int udmabuf_fd = -1;
+
+static void
+dma_memory_open_udmabuf(void)
+{
+    udmabuf_fd = open("/dev/udmabuf", O_RDWR | O_CLOEXEC);
+}
+
+/*
+ * Wraps the memfd pages in a dma-buf.
+ * Returns the dma-buf fd, or -1 if udmabuf is not available.
+ */
+static int
+dma_memory_create_dmabuf(int memfd, size_t size)
+{
+    struct udmabuf_create create;
+
+    pthread_once(&udmabuf_once, dma_memory_open_udmabuf);
+    if (udmabuf_fd < 0)
+        return -1;
+
+    memset(&create, 0, sizeof(create));
+    create.memfd = memfd;
+    create.flags = UDMABUF_FLAGS_CLOEXEC;
+    create.offset = 0;
+    create.size = size;
+    return ioctl(udmabuf_fd, UDMABUF_CREATE, &create);
+}
+
+/*
+ * Return 0 on success, -1 on error
+ */
+static int
+dma_memory_create(dma_memory_p mem, size_t size)
+{
+    size_t page_size = sysconf(_SC_PAGESIZE);
+
+    mem->size = (size + DMA_MEMORY_PADDING + page_size - 1) & ~(page_size - 1);
+    mem->memfd = syscall(SYS_memfd_create, "rockchip-va", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (mem->memfd < 0)
+        return -1;
+
+    /* udmabuf insists the backing memfd can't shrink under it */
+    if (ftruncate(mem->memfd, mem->size) ||
+        fcntl(mem->memfd, F_ADD_SEALS, F_SEAL_SHRINK)) {
+        close(mem->memfd);
+        return -1;
+    }
+
+    mem->data = mmap(NULL, mem->size, PROT_READ | PROT_WRITE, MAP_SHARED, mem->memfd, 0);
+    if (MAP_FAILED == mem->data) {
+        close(mem->memfd);
+        return -1;
+    }
+
+    mem->dmabuf_fd = dma_memory_create_dmabuf(mem->memfd, mem->size);
+    /* Shared memfd pages are ordinary page cache */
+    mem->caching = DMA_MEMORY_CACHED;
+    return 0;
+}
+
+static void
+dma_memory_release(dma_memory_p mem)
+{
+    munmap(mem->data, mem->size);
+    if (mem->dmabuf_fd >= 0)
+        close(mem->dmabuf_fd);
+    close(mem->memfd);
+}
+
+int
+dma_memory_cache_init(dma_memory_cache_p cache, size_t max_bytes)
+{
+    cache->max_bytes = max_bytes;
+    cache->cached_bytes = 0;
+    cache->num_blocks = 0;
+    return pthread_mutex_init(&cache->mutex, NULL) ? -1 : 0;
+}
+
+void
+dma_memory_cache_destroy(dma_memory_cache_p cache)
+{
+    while (cache->num_blocks)
+        dma_memory_release(&cache->blocks[--cache->num_blocks]);
+    pthread_mutex_destroy(&cache->mutex);
+}
+
+int
+dma_memory_alloc(dma_memory_cache_p cache, dma_memory_p mem, size_t size)
+{
+    int found = 0;
+    int i;
+
+    /* Reuse the first cached block that fits without wasting over half */
+    pthread_mutex_lock(&cache->mutex);
+    for (i = cache->num_blocks; i--;) {
+        size_t cached = cache->blocks[i].size;
+
+        if (cached >= size + DMA_MEMORY_PADDING && cached / 2 <= size + DMA_MEMORY_PADDING) {
+            *mem = cache->blocks[i];
+            cache->blocks[i] = cache->blocks[--cache->num_blocks];
+            cache->cached_bytes -= cached;
+            found = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&cache->mutex);
+
+    if (!found && -1 == dma_memory_create(mem, size))
+        return -1;
+
+    memset(mem->data + size, 0, DMA_MEMORY_PADDING);
+    return 0;
+}
+
+void
+dma_memory_free(dma_memory_cache_p cache, dma_memory_p mem)
+{
+    pthread_mutex_lock(&cache->mutex);
+    if (cache->num_blocks < DMA_MEMORY_CACHE_SIZE &&
+        cache->cached_bytes + mem->size <= cache->max_bytes) {
+        cache->blocks[cache->num_blocks++] = *mem;
+        cache->cached_bytes += mem->size;
+        mem = NULL;
+    }
+    pthread_mutex_unlock(&cache->mutex);
+
+    if (mem)
+        dma_memory_release(mem);
+}
+
+void
+dma_memory_destroy(dma_memory_p mem)
+{
+    dma_memory_release(mem);
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2015 - 2016 Rockchip Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef DMA_MEMORY_H
+#define DMA_MEMORY_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+/* Released blocks kept for reuse by a dma_memory_cache */
+#define DMA_MEMORY_CACHE_SIZE   64
+
+/* Zeroed bytes guaranteed past the requested size */
+#define DMA_MEMORY_PADDING      64
+
+/* How memory is mapped into the CPU, which decides how to read it fast */
+enum {
+    DMA_MEMORY_CACHED,
+    DMA_MEMORY_WRITE_COMBINED,
+    DMA_MEMORY_UNCACHED,
+};
+
+typedef struct dma_memory *dma_memory_p;
+typedef struct dma_memory_cache *dma_memory_cache_p;
+
+/*
+ * Shareable memory: a sealed memfd mapped into the driver, and when the
+ * kernel offers /dev/udmabuf, a dma-buf wrapping the same pages. A device
+ * importing the dma-buf reads exactly what the CPU wrote to data.
+ */
+struct dma_memory {
+    void *data;
+    size_t size;        /* mapped bytes, a multiple of the page size */
+    int memfd;
+    int dmabuf_fd;      /* -1 without udmabuf */
+    int caching;        /* DMA_MEMORY_* */
+};
+
+struct dma_memory_cache {
+    pthread_mutex_t mutex;
+    size_t max_bytes;
+    size_t cached_bytes;
+    struct dma_memory blocks[DMA_MEMORY_CACHE_SIZE];
+    int num_blocks;
+};
+
+/*
+ * At most DMA_MEMORY_CACHE_SIZE released blocks, and at most max_bytes
+ * of them, are kept for reuse.
+ * Return 0 on success, -1 on error
+ */
+int
+dma_memory_cache_init(dma_memory_cache_p cache, size_t max_bytes);
+
+void
+dma_memory_cache_destroy(dma_memory_cache_p cache);
+
+/*
+ * Allocates at least size bytes, recycling a cached block if one fits.
+ * Return 0 on success, -1 on error
+ */
+int
+dma_memory_alloc(dma_memory_cache_p cache, dma_memory_p mem, size_t size);
+
+/*
+ * Returns the block to the cache, or to the system when the cache is full
+ * or the block would take it over max_bytes.
+ */
+void
+dma_memory_free(dma_memory_cache_p cache, dma_memory_p mem);
+
+/*
+ * Returns the block to the system. Used for memory that was exported,
+ * since an importer may still hold on to its pages.
+ */
+void
+dma_memory_destroy(dma_memory_p mem);
+
+/*
+ * Returns the fd to share the memory through: the dma-buf if there is
+ * one, else the memfd.
+ */
+static inline int
+dma_memory_fd(dma_memory_p mem)
+{
+    return mem->dmabuf_fd >= 0 ? mem->dmabuf_fd : mem->memfd;
+}
+
+#endif /* DMA_MEMORY_H */
@@ -0,0 +1,329 @@
+/*
+ * Copyright (c) 2015 - 2016 Rockchip Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <assert.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include "frame_arena.h"
+
+#define ASSERT  assert
+
+#define ALIGN(x, a)     (((x) + (a) - 1) & ~((size_t)(a) - 1))
+
+/* From linux/dma-heap.h, which older kernel headers lack */
+#ifndef DMA_HEAP_IOCTL_ALLOC
+struct dma_heap_allocation_data {
+    uint64_t len;
+    uint32_t fd;
+    uint32_t fd_flags;
+    uint64_t heap_flags;
+};
+#define DMA_HEAP_IOCTL_ALLOC    _IOWR('H', 0x0, struct dma_heap_allocation_data)
+#endif
+
+/*
+ * Maps size bytes of a new dma-buf from the arena's heap.
+ * Returns NULL on error
+ */
+static unsigned char *
+frame_chunk_map_heap(frame_arena_p arena, frame_chunk_p chunk, size_t size)
+{
+    struct dma_heap_allocation_data alloc;
+    unsigned char *base;
+
+    memset(&alloc, 0, sizeof(alloc));
+    alloc.len = size;
+    alloc.fd_flags = O_RDWR | O_CLOEXEC;
+    if (ioctl(arena->heap_fd, DMA_HEAP_IOCTL_ALLOC, &alloc))
+        return NULL;
+
+    base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, alloc.fd, 0);
+    if (MAP_FAILED == base) {
+        close(alloc.fd);
+        return NULL;
+    }
+    chunk->fd = alloc.fd;
+    return base;
+}
+
+/*
+ * Maps a huge page aligned chunk of anonymous memory.
+ * Returns NULL on error
+ */
+static unsigned char *
+frame_chunk_map_anonymous(size_t size)
+{
+    unsigned char *map, *base;
+    size_t map_size = size + FRAME_ARENA_HUGE_PAGE;
+
+    /* Over-map, then trim to a huge page boundary */
+    map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == map)
+        return NULL;
+    base = (unsigned char *) ALIGN((size_t) map, FRAME_ARENA_HUGE_PAGE);
+    if (base > map)
+        munmap(map, base - map);
+    if (map + map_size > base + size)
+        munmap(base + size, map + map_size - (base + size));
+
+#ifdef MADV_HUGEPAGE
+    madvise(base, size, MADV_HUGEPAGE);
+#endif
+    return base;
+}
+
+/*
+ * Maps a chunk of at least size bytes, from the arena's heap if it has one.
+ * Returns NULL on error
+ */
+static frame_chunk_p
+frame_chunk_create(frame_arena_p arena, size_t size)
+{
+    frame_chunk_p chunk;
+    unsigned char *base;
+
+    size = ALIGN(size > FRAME_ARENA_CHUNK_SIZE ? size : FRAME_ARENA_CHUNK_SIZE, FRAME_ARENA_HUGE_PAGE);
+
+    chunk = malloc(sizeof(*chunk));
+    if (NULL == chunk)
+        return NULL;
+    chunk->free = malloc(sizeof(*chunk->free));
+    if (NULL == chunk->free) {
+        free(chunk);
+        return NULL;
+    }
+
+    chunk->fd = -1;
+    base = arena->heap_fd >= 0 ? frame_chunk_map_heap(arena, chunk, size) : frame_chunk_map_anonymous(size);
+    if (NULL == base) {
+        free(chunk->free);
+        free(chunk);
+        return NULL;
+    }
+
+    chunk->base = base;
+    chunk->size = size;
+    chunk->used = 0;
+    chunk->free->offset = 0;
+    chunk->free->size = size;
+    chunk->free->next = NULL;
+    chunk->next = NULL;
+    return chunk;
+}
+
+static void
+frame_chunk_destroy(frame_chunk_p chunk)
+{
+    frame_extent_p extent, next;
+
+    for (extent = chunk->free; extent; extent = next) {
+        next = extent->next;
+        free(extent);
+    }
+    munmap(chunk->base, chunk->size);
+    if (chunk->fd >= 0)
+        close(chunk->fd);
+    free(chunk);
+}
+
+/*
+ * Carves size bytes from the first free extent that fits.
+ * Returns NULL if the chunk has no room
+ */
+static void *
+frame_chunk_carve(frame_chunk_p chunk, size_t size)
+{
+    frame_extent_p *link, extent;
+    void *frame;
+
+    for (link = &chunk->free; (extent = *link); link = &extent->next) {
+        if (extent->size < size)
+            continue;
+
+        frame = chunk->base + extent->offset;
+        extent->offset += size;
+        extent->size -= size;
+        if (0 == extent->size) {
+            *link = extent->next;
+            free(extent);
+        }
+        chunk->used += size;
+        return frame;
+    }
+    return NULL;
+}
+
+/*
+ * Returns a range to its chunk, merging it with free neighbours.
+ * Return 0 on success, -1 if no extent could be allocated
+ */
+static int
+frame_chunk_release(frame_chunk_p chunk, void *frame, size_t size)
+{
+    size_t offset = (unsigned char *) frame - chunk->base;
+    frame_extent_p *link, prev = NULL, extent;
+
+    for (link = &chunk->free; *link && (*link)->offset < offset; link = &(*link)->next)
+        prev = *link;
+
+    if (prev && prev->offset + prev->size == offset) {
+        prev->size += size;
+        extent = prev;
+    } else {
+        extent = malloc(sizeof(*extent));
+        if (NULL == extent)
+            return -1;
+        extent->offset = offset;
+        extent->size = size;
+        extent->next = *link;
+        *link = extent;
+    }
+
+    if (extent->next && extent->offset + extent->size == extent->next->offset) {
+        frame_extent_p next = extent->next;
+
+        extent->size += next->size;
+        extent->next = next->next;
+        free(next);
+    }
+    chunk->used -= size;
+    return 0;
+}
+
+int
+frame_arena_init(frame_arena_p arena, const char *heap)
+{
+    char path[64];
+
+    arena->chunks = NULL;
+    arena->heap_fd = -1;
+    arena->caching = DMA_MEMORY_CACHED;
+    if (heap) {
+        snprintf(path, sizeof(path), "/dev/dma_heap/%s", heap);
+        arena->heap_fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (arena->heap_fd >= 0 && strstr(heap, "uncached"))
+            arena->caching = DMA_MEMORY_WRITE_COMBINED;
+    }
+
+    if (pthread_mutex_init(&arena->mutex, NULL)) {
+        if (arena->heap_fd >= 0)
+            close(arena->heap_fd);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Must be called with the arena mutex held.
+ */
+static void
+frame_arena_free_unlocked(frame_arena_p arena, size_t size, int n, void **frames)
+{
+    frame_chunk_p chunk, *link;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (NULL == frames[i])
+            continue;
+
+        for (link = &arena->chunks; (chunk = *link); link = &chunk->next) {
+            if ((unsigned char *) frames[i] >= chunk->base &&
+                (unsigned char *) frames[i] < chunk->base + chunk->size)
+                break;
+        }
+        ASSERT(chunk);
+        if (NULL == chunk || -1 == frame_chunk_release(chunk, frames[i], size))
+            continue; /* Leaks the range rather than corrupting the arena */
+
+        /* Keep the first chunk mapped, hand back the others once empty */
+        if (0 == chunk->used && chunk != arena->chunks) {
+            *link = chunk->next;
+            frame_chunk_destroy(chunk);
+        }
+    }
+}
+
+int
+frame_arena_alloc_n(frame_arena_p arena, size_t size, int n, void **frames)
+{
+    frame_chunk_p chunk;
+    int i;
+
+    size = ALIGN(size, FRAME_ARENA_ALIGNMENT);
+
+    pthread_mutex_lock(&arena->mutex);
+    for (i = 0; i < n; i++) {
+        frames[i] = NULL;
+        for (chunk = arena->chunks; chunk && !frames[i]; chunk = chunk->next)
+            frames[i] = frame_chunk_carve(chunk, size);
+
+        if (NULL == frames[i]) {
+            /* Room for the rest of the batch in one new chunk */
+            chunk = frame_chunk_create(arena, size * (n - i));
+            if (NULL == chunk)
+                break;
+            chunk->next = arena->chunks;
+            arena->chunks = chunk;
+            frames[i] = frame_chunk_carve(chunk, size);
+        }
+    }
+    if (i < n)
+        frame_arena_free_unlocked(arena, size, i, frames);
+    pthread_mutex_unlock(&arena->mutex);
+    return i < n ? -1 : 0;
+}
+
+void
+frame_arena_free_n(frame_arena_p arena, size_t size, int n, void **frames)
+{
+    size = ALIGN(size, FRAME_ARENA_ALIGNMENT);
+
+    pthread_mutex_lock(&arena->mutex);
+    frame_arena_free_unlocked(arena, size, n, frames);
+    pthread_mutex_unlock(&arena->mutex);
+}
+
+void
+frame_arena_destroy(frame_arena_p arena)
+{
+    frame_chunk_p chunk, next;
+
+    for (chunk = arena->chunks; chunk; chunk = next) {
+        next = chunk->next;
+        ASSERT(0 == chunk->used);
+        frame_chunk_destroy(chunk);
+    }
+    arena->chunks = NULL;
+    if (arena->heap_fd >= 0)
+        close(arena->heap_fd);
+    arena->heap_fd = -1;
+    pthread_mutex_destroy(&arena->mutex);
+}
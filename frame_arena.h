@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2015 - 2016 Rockchip Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include "dma_memory.h"
+
+/* Chunks are mapped in multiples of this and advised for huge pages */
+#define FRAME_ARENA_HUGE_PAGE       (2 * 1024 * 1024)
+#define FRAME_ARENA_CHUNK_SIZE      (32 * 1024 * 1024)
+/* Every carve is page aligned and a page multiple */
+#define FRAME_ARENA_ALIGNMENT       4096
+
+typedef struct frame_arena *frame_arena_p;
+typedef struct frame_chunk *frame_chunk_p;
+typedef struct frame_extent *frame_extent_p;
+
+/* Free range of a chunk, kept sorted by offset */
+struct frame_extent {
+    size_t offset;
+    size_t size;
+    frame_extent_p next;
+};
+
+struct frame_chunk {
+    unsigned char *base;
+    size_t size;
+    int fd;             /* dma-buf of a heap chunk, -1 for anonymous memory */
+    size_t used;
+    frame_extent_p free;
+    frame_chunk_p next;
+};
+
+/*
+ * Pixel memory for surfaces. Large 2 MB aligned chunks are carved into
+ * frames first fit, so a whole DPB costs a handful of TLB entries when
+ * transparent huge pages are enabled, and one lock round trip to create.
+ * Chunks can come from a dma-buf heap instead, as memory the decoder
+ * hardware writes to, mapped the way the heap maps it.
+ */
+struct frame_arena {
+    pthread_mutex_t mutex;
+    frame_chunk_p chunks;
+    int heap_fd;        /* -1 for anonymous memory */
+    int caching;        /* DMA_MEMORY_* mapping of every frame */
+};
+
+/*
+ * heap names a dma-buf heap in /dev/dma_heap to take chunks from, NULL
+ * for anonymous memory. The "uncached" heaps of Rockchip kernels map
+ * their buffers write-combined, others are cached. A heap that can't be
+ * opened leaves the arena on anonymous memory, see heap_fd.
+ * Return 0 on success, -1 on error
+ */
+int
+frame_arena_init(frame_arena_p arena, const char *heap);
+
+/*
+ * Carves n frames of size bytes each, all or nothing.
+ * Return 0 on success, -1 on error
+ */
+int
+frame_arena_alloc_n(frame_arena_p arena, size_t size, int n, void **frames);
+
+/*
+ * Returns n frames of size bytes each to the arena. NULL entries are skipped.
+ */
+void
+frame_arena_free_n(frame_arena_p arena, size_t size, int n, void **frames);
+
+/*
+ * Unmaps all chunks, every frame must have been freed.
+ */
+void
+frame_arena_destroy(frame_arena_p arena);
+
+#endif /* FRAME_ARENA_H */
@@ -0,0 +1,1328 @@
+/*
+ * Copyright (c) 2015 - 2016 Rockchip Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <string.h>
+#include "image_convert.h"
+#include "cpu_features.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define IMAGE_CONVERT_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/*
+ * x86 variants are built for their instruction set whatever the compiler
+ * flags, image_convert_init() only binds those the CPU has. NEON is
+ * part of the build target where it is used.
+ */
+#define IMAGE_CONVERT_TARGET_sse2   __attribute__((target("sse2")))
+#define IMAGE_CONVERT_TARGET_ssse3  __attribute__((target("ssse3")))
+#define IMAGE_CONVERT_TARGET_sse41  __attribute__((target("sse4.1")))
+#define IMAGE_CONVERT_TARGET_avx2   __attribute__((target("avx2")))
+#define IMAGE_CONVERT_TARGET_neon
+
+/*
+ * NV15 groups of eight samples take ten bytes. Sample i starts at byte
+ * (10 * i) / 8 and bit (2 * i) % 8 of it.
+ */
+#define NV15_GATHER     0, 1, 1, 2, 2, 3, 3, 4, 5, 6, 6, 7, 7, 8, 8, 9
+#define NV15_SCATTER_LO 0, 2, 4, 6, -1, 8, 10, 12, 14, -1, -1, -1, -1, -1, -1, -1
+#define NV15_SCATTER_HI -1, 1, 3, 5, 7, -1, 9, 11, 13, 15, -1, -1, -1, -1, -1, -1
+
+typedef void (*image_convert_row_func)(uint8_t *dst, const uint8_t *y,
+                                       const uint8_t *uv, unsigned int width);
+
+/* Row kernels, bound to the best variant for the CPU by image_convert_init() */
+static struct {
+    void (*deinterleave)(uint8_t *u, uint8_t *v, const uint8_t *uv, unsigned int n);
+    void (*interleave)(uint8_t *uv, const uint8_t *u, const uint8_t *v, unsigned int n);
+    void (*read_uncached)(uint8_t *dst, const uint8_t *src, size_t size);
+    image_convert_row_func nv12_to_yuy2;
+    image_convert_row_func nv12_to_uyvy;
+    image_convert_row_func nv12_to_rgbx;
+    image_convert_row_func nv12_to_bgrx;
+    void (*widen)(uint16_t *dst, const uint8_t *src, unsigned int n);
+    void (*nv15_to_p010)(uint16_t *dst, const uint8_t *src, unsigned int n);
+    void (*p010_to_nv15)(uint8_t *dst, const uint16_t *src, unsigned int n);
+    int (*detile_tiles)(uint8_t *dst, unsigned int dst_pitch, const uint8_t *src,
+                        unsigned int tile_width, unsigned int tile_height,
+                        unsigned int first_line, unsigned int num_lines, unsigned int n);
+    void (*box2)(uint8_t *dst, const uint8_t *src0, const uint8_t *src1, unsigned int n);
+} image_convert_kernels;
+
+void
+image_convert_deinterleave_c(uint8_t *u, uint8_t *v, const uint8_t *uv, unsigned int n)
+{
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+        u[i] = uv[2 * i];
+        v[i] = uv[2 * i + 1];
+    }
+}
+
+#if defined(IMAGE_CONVERT_X86)
+static IMAGE_CONVERT_TARGET_avx2 void
+image_convert_deinterleave_avx2(uint8_t *u, uint8_t *v, const uint8_t *uv, unsigned int n)
+{
+    const __m256i mask = _mm256_set1_epi16(0x00ff);
+    unsigned int i;
+
+    for (i = 0; i + 32 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(uv + 2 * i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(uv + 2 * i + 32));
+        /* packus works per 128 bit lane, the permute restores order */
+        __m256i lo = _mm256_packus_epi16(_mm256_and_si256(a, mask), _mm256_and_si256(b, mask));
+        __m256i hi = _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+        _mm256_storeu_si256((__m256i *)(u + i), _mm256_permute4x64_epi64(lo, 0xd8));
+        _mm256_storeu_si256((__m256i *)(v + i), _mm256_permute4x64_epi64(hi, 0xd8));
+    }
+    image_convert_deinterleave_c(u + i, v + i, uv + 2 * i, n - i);
+}
+
+static IMAGE_CONVERT_TARGET_sse2 void
+image_convert_deinterleave_sse2(uint8_t *u, uint8_t *v, const uint8_t *uv, unsigned int n)
+{
+    const __m128i mask = _mm_set1_epi16(0x00ff);
+    unsigned int i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(uv + 2 * i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(uv + 2 * i + 16));
+        _mm_storeu_si128((__m128i *)(u + i),
+                         _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask)));
+        _mm_storeu_si128((__m128i *)(v + i),
+                         _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+    }
+    image_convert_deinterleave_c(u + i, v + i, uv + 2 * i, n - i);
+}
+#elif defined(__ARM_NEON)
+static void
+image_convert_deinterleave_neon(uint8_t *u, uint8_t *v, const uint8_t *uv, unsigned int n)
+{
+    unsigned int i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        uint8x16x2_t p = vld2q_u8(uv + 2 * i);
+        vst1q_u8(u + i, p.val[0]);
+        vst1q_u8(v + i, p.val[1]);
+    }
+    image_convert_deinterleave_c(u + i, v + i, uv + 2 * i, n - i);
+}
+#endif
+
+void
+image_convert_deinterleave(uint8_t *u, uint8_t *v, const uint8_t *uv, unsigned int n)
+{
+    image_convert_kernels.deinterleave(u, v, uv, n);
+}
+
+void
+image_convert_interleave_c(uint8_t *uv, const uint8_t *u, const uint8_t *v, unsigned int n)
+{
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+        uv[2 * i] = u[i];
+        uv[2 * i + 1] = v[i];
+    }
+}
+
+#if defined(IMAGE_CONVERT_X86)
+static IMAGE_CONVERT_TARGET_avx2 void
+image_convert_interleave_avx2(uint8_t *uv, const uint8_t *u, const uint8_t *v, unsigned int n)
+{
+    unsigned int i;
+
+    for (i = 0; i + 32 <= n; i += 32) {
+        /* unpack works per 128 bit lane, the permutes pre-arrange it */
+        __m256i a = _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i *)(u + i)), 0xd8);
+        __m256i b = _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i *)(v + i)), 0xd8);
+        _mm256_storeu_si256((__m256i *)(uv + 2 * i), _mm256_unpacklo_epi8(a, b));
+        _mm256_storeu_si256((__m256i *)(uv + 2 * i + 32), _mm256_unpackhi_epi8(a, b));
+    }
+    image_convert_interleave_c(uv + 2 * i, u + i, v + i, n - i);
+}
+
+static IMAGE_CONVERT_TARGET_sse2 void
+image_convert_interleave_sse2(uint8_t *uv, const uint8_t *u, const uint8_t *v, unsigned int n)
+{
+    unsigned int i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(u + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(v + i));
+        _mm_storeu_si128((__m128i *)(uv + 2 * i), _mm_unpacklo_epi8(a, b));
+        _mm_storeu_si128((__m128i *)(uv + 2 * i + 16), _mm_unpackhi_epi8(a, b));
+    }
+    image_convert_interleave_c(uv + 2 * i, u + i, v + i, n - i);
+}
+#elif defined(__ARM_NEON)
+static void
+image_convert_interleave_neon(uint8_t *uv, const uint8_t *u, const uint8_t *v, unsigned int n)
+{
+    unsigned int i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        uint8x16x2_t p;
+        p.val[0] = vld1q_u8(u + i);
+        p.val[1] = vld1q_u8(v + i);
+        vst2q_u8(uv + 2 * i, p);
+    }
+    image_convert_interleave_c(uv + 2 * i, u + i, v + i, n - i);
+}
+#endif
+
+void
+image_convert_interleave(uint8_t *uv, const uint8_t *u, const uint8_t *v, unsigned int n)
+{
+    image_convert_kernels.interleave(uv, u, v, n);
+}
+
+void
+image_convert_copy_plane(uint8_t *dst, unsigned int dst_pitch,
+                         const uint8_t *src, unsigned int src_pitch,
+                         unsigned int width, unsigned int height)
+{
+    unsigned int y;
+
+    if (dst_pitch == width && src_pitch == width) {
+        memcpy(dst, src, (size_t)width * height);
+        return;
+    }
+    for (y = 0; y < height; y++)
+        memcpy(dst + (size_t)y * dst_pitch, src + (size_t)y * src_pitch, width);
+}
+
+/*
+ * Copies up to the first 64 byte boundary of src, streaming loads want
+ * aligned addresses. Returns the bytes copied.
+ */
+static size_t
+image_convert_uncached_head(uint8_t *dst, const uint8_t *src, size_t size)
+{
+    size_t head = -(uintptr_t)src & 63;
+
+    if (head > size)
+        head = size;
+    memcpy(dst, src, head);
+    return head;
+}
+
+static void
+image_convert_read_uncached_c(uint8_t *dst, const uint8_t *src, size_t size)
+{
+    memcpy(dst, src, size);
+}
+
+#if defined(IMAGE_CONVERT_X86)
+static IMAGE_CONVERT_TARGET_sse41 void
+image_convert_read_uncached_sse41(uint8_t *dst, const uint8_t *src, size_t size)
+{
+    size_t head = image_convert_uncached_head(dst, src, size);
+
+    dst += head;
+    src += head;
+    size -= head;
+    for (; size >= 64; size -= 64, src += 64, dst += 64) {
+        _mm_prefetch((const char *)src + 512, _MM_HINT_NTA);
+        __m128i a = _mm_stream_load_si128((__m128i *)src);
+        __m128i b = _mm_stream_load_si128((__m128i *)(src + 16));
+        __m128i c = _mm_stream_load_si128((__m128i *)(src + 32));
+        __m128i d = _mm_stream_load_si128((__m128i *)(src + 48));
+        _mm_storeu_si128((__m128i *)dst, a);
+        _mm_storeu_si128((__m128i *)(dst + 16), b);
+        _mm_storeu_si128((__m128i *)(dst + 32), c);
+        _mm_storeu_si128((__m128i *)(dst + 48), d);
+    }
+    memcpy(dst, src, size);
+}
+
+static IMAGE_CONVERT_TARGET_sse2 void
+image_convert_read_uncached_sse2(uint8_t *dst, const uint8_t *src, size_t size)
+{
+    size_t head = image_convert_uncached_head(dst, src, size);
+
+    dst += head;
+    src += head;
+    size -= head;
+    for (; size >= 64; size -= 64, src += 64, dst += 64) {
+        _mm_prefetch((const char *)src + 512, _MM_HINT_NTA);
+        __m128i a = _mm_load_si128((const __m128i *)src);
+        __m128i b = _mm_load_si128((const __m128i *)(src + 16));
+        __m128i c = _mm_load_si128((const __m128i *)(src + 32));
+        __m128i d = _mm_load_si128((const __m128i *)(src + 48));
+        _mm_storeu_si128((__m128i *)dst, a);
+        _mm_storeu_si128((__m128i *)(dst + 16), b);
+        _mm_storeu_si128((__m128i *)(dst + 32), c);
+        _mm_storeu_si128((__m128i *)(dst + 48), d);
+    }
+    memcpy(dst, src, size);
+}
+#elif defined(__aarch64__)
+static void
+image_convert_read_uncached_neon(uint8_t *dst, const uint8_t *src, size_t size)
+{
+    size_t head = image_convert_uncached_head(dst, src, size);
+
+    dst += head;
+    src += head;
+    size -= head;
+    for (; size >= 64; size -= 64, src += 64, dst += 64) {
+        __asm__ volatile("prfm pldl1strm, [%1, #512]\n\t"
+                         "ldnp q0, q1, [%1]\n\t"
+                         "ldnp q2, q3, [%1, #32]\n\t"
+                         "stp q0, q1, [%0]\n\t"
+                         "stp q2, q3, [%0, #32]"
+                         : : "r"(dst), "r"(src) : "v0", "v1", "v2", "v3", "memory");
+    }
+    memcpy(dst, src, size);
+}
+#endif
+
+void
+image_convert_read_uncached(uint8_t *dst, const uint8_t *src, size_t size)
+{
+    image_convert_kernels.read_uncached(dst, src, size);
+}
+
+void
+image_convert_read_plane_uncached(uint8_t *dst, unsigned int dst_pitch,
+                                  const uint8_t *src, unsigned int src_pitch,
+                                  unsigned int width, unsigned int height)
+{
+    unsigned int y;
+
+    for (y = 0; y < height; y++)
+        image_convert_read_uncached(dst + (size_t)y * dst_pitch, src + (size_t)y * src_pitch, width);
+}
+
+void
+image_convert_nv12_to_yuv420(uint8_t *dst_y, unsigned int dst_y_pitch,
+                             uint8_t *dst_u, unsigned int dst_u_pitch,
+                             uint8_t *dst_v, unsigned int dst_v_pitch,
+                             const uint8_t *src_y, unsigned int src_y_pitch,
+                             const uint8_t *src_uv, unsigned int src_uv_pitch,
+                             unsigned int width, unsigned int height)
+{
+    unsigned int y;
+
+    image_convert_copy_plane(dst_y, dst_y_pitch, src_y, src_y_pitch, width, height);
+    for (y = 0; y < (height + 1) / 2; y++)
+        image_convert_deinterleave(dst_u + (size_t)y * dst_u_pitch,
+                                   dst_v + (size_t)y * dst_v_pitch,
+                                   src_uv + (size_t)y * src_uv_pitch, (width + 1) / 2);
+}
+
+void
+image_convert_yuv420_to_nv12(uint8_t *dst_y, unsigned int dst_y_pitch,
+                             uint8_t *dst_uv, unsigned int dst_uv_pitch,
+                             const uint8_t *src_y, unsigned int src_y_pitch,
+                             const uint8_t *src_u, unsigned int src_u_pitch,
+                             const uint8_t *src_v, unsigned int src_v_pitch,
+                             unsigned int width, unsigned int height)
+{
+    unsigned int y;
+
+    image_convert_copy_plane(dst_y, dst_y_pitch, src_y, src_y_pitch, width, height);
+    for (y = 0; y < (height + 1) / 2; y++)
+        image_convert_interleave(dst_uv + (size_t)y * dst_uv_pitch,
+                                 src_u + (size_t)y * src_u_pitch,
+                                 src_v + (size_t)y * src_v_pitch, (width + 1) / 2);
+}
+
+/*
+ * Row kernels, one per target layout. The frame loop pairs every luma
+ * row with its 4:2:0 chroma row.
+ */
+#define IMAGE_CONVERT_FRAME(name)                                                   \
+IMAGE_CONVERT_NV12_TO_PACKED(name)                                                  \
+{                                                                                   \
+    unsigned int y;                                                                 \
+                                                                                    \
+    for (y = 0; y < height; y++)                                                    \
+        image_convert_kernels.nv12_to_##name(dst + (size_t)y * dst_pitch,           \
+                                             src_y + (size_t)y * src_y_pitch,       \
+                                             src_uv + (size_t)(y / 2) * src_uv_pitch, \
+                                             width);                                \
+}
+
+/*
+ * Vector variant of a row kernel: a shared block loop for the layout
+ * family, which returns the pixels it did, then the scalar row for the
+ * rest. arg tells the family members apart.
+ */
+#define IMAGE_CONVERT_ROW_VARIANT(name, family, isa, arg, bpp)                      \
+static IMAGE_CONVERT_TARGET_##isa void                                              \
+image_convert_nv12_to_##name##_row_##isa(uint8_t *dst, const uint8_t *y,            \
+                                         const uint8_t *uv, unsigned int width)     \
+{                                                                                   \
+    unsigned int i = image_convert_##family##_##isa(dst, y, uv, width, arg);        \
+                                                                                    \
+    image_convert_nv12_to_##name##_row_c(dst + (bpp) * i, y + i, uv + i, width - i); \
+}
+
+/* 4:2:2 packed, Y0 U Y1 V at the given byte positions */
+#define IMAGE_CONVERT_PACKED_422(name, y0, u, y1, v)                                \
+static void                                                                         \
+image_convert_nv12_to_##name##_row_c(uint8_t *dst, const uint8_t *y,                \
+                                     const uint8_t *uv, unsigned int width)         \
+{                                                                                   \
+    unsigned int i;                                                                 \
+                                                                                    \
+    for (i = 0; i < width / 2; i++) {                                               \
+        dst[4 * i + y0] = y[2 * i];                                                 \
+        dst[4 * i + u] = uv[2 * i];                                                 \
+        dst[4 * i + y1] = y[2 * i + 1];                                             \
+        dst[4 * i + v] = uv[2 * i + 1];                                             \
+    }                                                                               \
+    if (width & 1) {                                                                \
+        dst[4 * i + y0] = y[2 * i];                                                 \
+        dst[4 * i + u] = uv[2 * i];                                                 \
+        dst[4 * i + y1] = y[2 * i];                                                 \
+        dst[4 * i + v] = uv[2 * i + 1];                                             \
+    }                                                                               \
+}                                                                                   \
+IMAGE_CONVERT_FRAME(name)
+
+IMAGE_CONVERT_PACKED_422(yuy2, 0, 1, 2, 3)
+IMAGE_CONVERT_PACKED_422(uyvy, 1, 0, 3, 2)
+
+/*
+ * Luma bytes interleaved with the chroma pair bytes make YUY2, the other
+ * way round UYVY
+ */
+#if defined(IMAGE_CONVERT_X86)
+static IMAGE_CONVERT_TARGET_avx2 unsigned int
+image_convert_packed_422_avx2(uint8_t *dst, const uint8_t *y, const uint8_t *uv,
+                              unsigned int width, int chroma_first)
+{
+    unsigned int i;
+
+    for (i = 0; i + 32 <= width; i += 32) {
+        __m256i a = _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i *)(y + i)), 0xd8);
+        __m256i b = _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i *)(uv + i)), 0xd8);
+
+        if (chroma_first) {
+            __m256i t = a;
+            a = b;
+            b = t;
+        }
+        _mm256_storeu_si256((__m256i *)(dst + 2 * i), _mm256_unpacklo_epi8(a, b));
+        _mm256_storeu_si256((__m256i *)(dst + 2 * i + 32), _mm256_unpackhi_epi8(a, b));
+    }
+    return i;
+}
+
+static IMAGE_CONVERT_TARGET_sse2 unsigned int
+image_convert_packed_422_sse2(uint8_t *dst, const uint8_t *y, const uint8_t *uv,
+                              unsigned int width, int chroma_first)
+{
+    unsigned int i;
+
+    for (i = 0; i + 16 <= width; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(y + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(uv + i));
+
+        if (chroma_first) {
+            __m128i t = a;
+            a = b;
+            b = t;
+        }
+        _mm_storeu_si128((__m128i *)(dst + 2 * i), _mm_unpacklo_epi8(a, b));
+        _mm_storeu_si128((__m128i *)(dst + 2 * i + 16), _mm_unpackhi_epi8(a, b));
+    }
+    return i;
+}
+
+IMAGE_CONVERT_ROW_VARIANT(yuy2, packed_422, avx2, 0, 2)
+IMAGE_CONVERT_ROW_VARIANT(uyvy, packed_422, avx2, 1, 2)
+IMAGE_CONVERT_ROW_VARIANT(yuy2, packed_422, sse2, 0, 2)
+IMAGE_CONVERT_ROW_VARIANT(uyvy, packed_422, sse2, 1, 2)
+#elif defined(__ARM_NEON)
+static unsigned int
+image_convert_packed_422_neon(uint8_t *dst, const uint8_t *y, const uint8_t *uv,
+                              unsigned int width, int chroma_first)
+{
+    unsigned int i;
+
+    for (i = 0; i + 16 <= width; i += 16) {
+        uint8x16x2_t p;
+
+        p.val[chroma_first] = vld1q_u8(y + i);
+        p.val[!chroma_first] = vld1q_u8(uv + i);
+        vst2q_u8(dst + 2 * i, p);
+    }
+    return i;
+}
+
+IMAGE_CONVERT_ROW_VARIANT(yuy2, packed_422, neon, 0, 2)
+IMAGE_CONVERT_ROW_VARIANT(uyvy, packed_422, neon, 1, 2)
+#endif
+
+static inline uint8_t
+image_convert_clamp(int v)
+{
+    return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+/* BT.601 limited range, 8.8 fixed point, R G B X at the given byte positions */
+#define IMAGE_CONVERT_RGBX(name, r, g, b, x)                                        \
+static void                                                                         \
+image_convert_nv12_to_##name##_row_c(uint8_t *dst, const uint8_t *y,                \
+                                     const uint8_t *uv, unsigned int width)         \
+{                                                                                   \
+    unsigned int i;                                                                 \
+                                                                                    \
+    for (i = 0; i < width; i++) {                                                   \
+        int c = 298 * (y[i] - 16);                                                  \
+        int d = uv[i & ~1u] - 128;                                                  \
+        int e = uv[i | 1u] - 128;                                                   \
+                                                                                    \
+        dst[4 * i + r] = image_convert_clamp((c + 409 * e + 128) >> 8);             \
+        dst[4 * i + g] = image_convert_clamp((c - 100 * d - 208 * e + 128) >> 8);   \
+        dst[4 * i + b] = image_convert_clamp((c + 516 * d + 128) >> 8);             \
+        dst[4 * i + x] = 0xff;                                                      \
+    }                                                                               \
+}                                                                                   \
+IMAGE_CONVERT_FRAME(name)
+
+IMAGE_CONVERT_RGBX(rgbx, 0, 1, 2, 3)
+IMAGE_CONVERT_RGBX(bgrx, 2, 1, 0, 3)
+
+/*
+ * The same arithmetic in 32 bit lanes: multiply-adds of (Y - 16, 1) by
+ * (298, 128) and of (U - 128, V - 128) by each channel's pair, then
+ * saturating packs for the clamp. Bit exact with the scalar rows.
+ */
+#if defined(IMAGE_CONVERT_X86)
+static IMAGE_CONVERT_TARGET_avx2 unsigned int
+image_convert_rgbx_avx2(uint8_t *dst, const uint8_t *y, const uint8_t *uv,
+                        unsigned int width, int bgr)
+{
+    const __m256i luma = _mm256_set1_epi32(128 << 16 | 298);
+    const __m256i coef_r = _mm256_setr_epi16(0, 409, 0, 409, 0, 409, 0, 409, 0, 409, 0, 409, 0, 409, 0, 409);
+    const __m256i coef_g = _mm256_setr_epi16(-100, -208, -100, -208, -100, -208, -100, -208,
+                                             -100, -208, -100, -208, -100, -208, -100, -208);
+    const __m256i coef_b = _mm256_setr_epi16(516, 0, 516, 0, 516, 0, 516, 0, 516, 0, 516, 0, 516, 0, 516, 0);
+    const __m256i one = _mm256_set1_epi16(1);
+    const __m256i alpha = _mm256_set1_epi8(-1);
+    unsigned int i;
+
+    /* Per 128 bit lane: pixels 0-7 in the low lane, 8-15 in the high one */
+    for (i = 0; i + 16 <= width; i += 16) {
+        __m256i luma16 = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(y + i))),
+                                          _mm256_set1_epi16(16));
+        __m256i chroma16 = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(uv + i))),
+                                            _mm256_set1_epi16(128));
+        __m256i chroma_lo = _mm256_unpacklo_epi32(chroma16, chroma16);
+        __m256i chroma_hi = _mm256_unpackhi_epi32(chroma16, chroma16);
+        __m256i luma_lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(luma16, one), luma);
+        __m256i luma_hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(luma16, one), luma);
+        __m256i r, g, b, rg, bx;
+
+#define IMAGE_CONVERT_CHANNEL_AVX2(coef)                                                          \
+        _mm256_packs_epi32(_mm256_srai_epi32(_mm256_add_epi32(luma_lo, _mm256_madd_epi16(chroma_lo, coef)), 8), \
+                           _mm256_srai_epi32(_mm256_add_epi32(luma_hi, _mm256_madd_epi16(chroma_hi, coef)), 8))
+        r = IMAGE_CONVERT_CHANNEL_AVX2(coef_r);
+        g = IMAGE_CONVERT_CHANNEL_AVX2(coef_g);
+        b = IMAGE_CONVERT_CHANNEL_AVX2(coef_b);
+#undef IMAGE_CONVERT_CHANNEL_AVX2
+        if (bgr) {
+            __m256i t = r;
+            r = b;
+            b = t;
+        }
+        rg = _mm256_unpacklo_epi8(_mm256_packus_epi16(r, r), _mm256_packus_epi16(g, g));
+        bx = _mm256_unpacklo_epi8(_mm256_packus_epi16(b, b), alpha);
+        r = _mm256_unpacklo_epi16(rg, bx);
+        g = _mm256_unpackhi_epi16(rg, bx);
+        _mm256_storeu_si256((__m256i *)(dst + 4 * i), _mm256_permute2x128_si256(r, g, 0x20));
+        _mm256_storeu_si256((__m256i *)(dst + 4 * i + 32), _mm256_permute2x128_si256(r, g, 0x31));
+    }
+    return i;
+}
+
+static IMAGE_CONVERT_TARGET_sse2 unsigned int
+image_convert_rgbx_sse2(uint8_t *dst, const uint8_t *y, const uint8_t *uv,
+                        unsigned int width, int bgr)
+{
+    const __m128i luma = _mm_set1_epi32(128 << 16 | 298);
+    const __m128i coef_r = _mm_setr_epi16(0, 409, 0, 409, 0, 409, 0, 409);
+    const __m128i coef_g = _mm_setr_epi16(-100, -208, -100, -208, -100, -208, -100, -208);
+    const __m128i coef_b = _mm_setr_epi16(516, 0, 516, 0, 516, 0, 516, 0);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i alpha = _mm_set1_epi8(-1);
+    unsigned int i;
+
+    for (i = 0; i + 8 <= width; i += 8) {
+        __m128i luma16 = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(y + i)), zero),
+                                       _mm_set1_epi16(16));
+        __m128i chroma16 = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(uv + i)), zero),
+                                         _mm_set1_epi16(128));
+        __m128i chroma_lo = _mm_unpacklo_epi32(chroma16, chroma16);
+        __m128i chroma_hi = _mm_unpackhi_epi32(chroma16, chroma16);
+        __m128i luma_lo = _mm_madd_epi16(_mm_unpacklo_epi16(luma16, one), luma);
+        __m128i luma_hi = _mm_madd_epi16(_mm_unpackhi_epi16(luma16, one), luma);
+        __m128i r, g, b, rg, bx;
+
+#define IMAGE_CONVERT_CHANNEL_SSE2(coef)                                                    \
+        _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(luma_lo, _mm_madd_epi16(chroma_lo, coef)), 8), \
+                        _mm_srai_epi32(_mm_add_epi32(luma_hi, _mm_madd_epi16(chroma_hi, coef)), 8))
+        r = IMAGE_CONVERT_CHANNEL_SSE2(coef_r);
+        g = IMAGE_CONVERT_CHANNEL_SSE2(coef_g);
+        b = IMAGE_CONVERT_CHANNEL_SSE2(coef_b);
+#undef IMAGE_CONVERT_CHANNEL_SSE2
+        if (bgr) {
+            __m128i t = r;
+            r = b;
+            b = t;
+        }
+        rg = _mm_unpacklo_epi8(_mm_packus_epi16(r, r), _mm_packus_epi16(g, g));
+        bx = _mm_unpacklo_epi8(_mm_packus_epi16(b, b), alpha);
+        _mm_storeu_si128((__m128i *)(dst + 4 * i), _mm_unpacklo_epi16(rg, bx));
+        _mm_storeu_si128((__m128i *)(dst + 4 * i + 16), _mm_unpackhi_epi16(rg, bx));
+    }
+    return i;
+}
+
+IMAGE_CONVERT_ROW_VARIANT(rgbx, rgbx, avx2, 0, 4)
+IMAGE_CONVERT_ROW_VARIANT(bgrx, rgbx, avx2, 1, 4)
+IMAGE_CONVERT_ROW_VARIANT(rgbx, rgbx, sse2, 0, 4)
+IMAGE_CONVERT_ROW_VARIANT(bgrx, rgbx, sse2, 1, 4)
+#elif defined(__ARM_NEON)
+static unsigned int
+image_convert_rgbx_neon(uint8_t *dst, const uint8_t *y, const uint8_t *uv,
+                        unsigned int width, int bgr)
+{
+    unsigned int i, h;
+
+    for (i = 0; i + 16 <= width; i += 16) {
+        uint8x16_t luma = vld1q_u8(y + i);
+        uint8x8x2_t chroma = vld2_u8(uv + i);
+        /* Every chroma pair serves two pixels */
+        uint8x8x2_t u = vzip_u8(chroma.val[0], chroma.val[0]);
+        uint8x8x2_t v = vzip_u8(chroma.val[1], chroma.val[1]);
+        uint8x8_t r[2], g[2], b[2];
+        uint8x16x4_t out;
+
+        for (h = 0; h < 2; h++) {
+            int16x8_t c = vreinterpretq_s16_u16(vsubl_u8(h ? vget_high_u8(luma) : vget_low_u8(luma), vdup_n_u8(16)));
+            int16x8_t d = vreinterpretq_s16_u16(vsubl_u8(u.val[h], vdup_n_u8(128)));
+            int16x8_t e = vreinterpretq_s16_u16(vsubl_u8(v.val[h], vdup_n_u8(128)));
+            int32x4_t l_lo = vmlal_n_s16(vdupq_n_s32(128), vget_low_s16(c), 298);
+            int32x4_t l_hi = vmlal_n_s16(vdupq_n_s32(128), vget_high_s16(c), 298);
+
+            r[h] = vqmovn_u16(vcombine_u16(vqshrun_n_s32(vmlal_n_s16(l_lo, vget_low_s16(e), 409), 8),
+                                           vqshrun_n_s32(vmlal_n_s16(l_hi, vget_high_s16(e), 409), 8)));
+            g[h] = vqmovn_u16(vcombine_u16(vqshrun_n_s32(vmlsl_n_s16(vmlsl_n_s16(l_lo, vget_low_s16(d), 100),
+                                                                     vget_low_s16(e), 208), 8),
+                                           vqshrun_n_s32(vmlsl_n_s16(vmlsl_n_s16(l_hi, vget_high_s16(d), 100),
+                                                                     vget_high_s16(e), 208), 8)));
+            b[h] = vqmovn_u16(vcombine_u16(vqshrun_n_s32(vmlal_n_s16(l_lo, vget_low_s16(d), 516), 8),
+                                           vqshrun_n_s32(vmlal_n_s16(l_hi, vget_high_s16(d), 516), 8)));
+        }
+        out.val[bgr ? 2 : 0] = vcombine_u8(r[0], r[1]);
+        out.val[1] = vcombine_u8(g[0], g[1]);
+        out.val[bgr ? 0 : 2] = vcombine_u8(b[0], b[1]);
+        out.val[3] = vdupq_n_u8(0xff);
+        vst4q_u8(dst + 4 * i, out);
+    }
+    return i;
+}
+
+IMAGE_CONVERT_ROW_VARIANT(rgbx, rgbx, neon, 0, 4)
+IMAGE_CONVERT_ROW_VARIANT(bgrx, rgbx, neon, 1, 4)
+#endif
+
+static void
+image_convert_widen_row_c(uint16_t *dst, const uint8_t *src, unsigned int n)
+{
+    unsigned int i;
+
+    for (i = 0; i < n; i++)
+        dst[i] = src[i] << 8;
+}
+
+#if defined(IMAGE_CONVERT_X86)
+static IMAGE_CONVERT_TARGET_avx2 void
+image_convert_widen_row_avx2(uint16_t *dst, const uint8_t *src, unsigned int n)
+{
+    unsigned int i;
+
+    for (i = 0; i + 16 <= n; i += 16)
+        _mm256_storeu_si256((__m256i *)(dst + i),
+                            _mm256_slli_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(src + i))), 8));
+    image_convert_widen_row_c(dst + i, src + i, n - i);
+}
+
+static IMAGE_CONVERT_TARGET_sse2 void
+image_convert_widen_row_sse2(uint16_t *dst, const uint8_t *src, unsigned int n)
+{
+    unsigned int i;
+
+    /* A zero low byte under each sample */
+    for (i = 0; i + 16 <= n; i += 16) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_unpacklo_epi8(_mm_setzero_si128(), s));
+        _mm_storeu_si128((__m128i *)(dst + i + 8), _mm_unpackhi_epi8(_mm_setzero_si128(), s));
+    }
+    image_convert_widen_row_c(dst + i, src + i, n - i);
+}
+#elif defined(__ARM_NEON)
+static void
+image_convert_widen_row_neon(uint16_t *dst, const uint8_t *src, unsigned int n)
+{
+    unsigned int i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        uint8x16_t s = vld1q_u8(src + i);
+        vst1q_u16(dst + i, vshll_n_u8(vget_low_u8(s), 8));
+        vst1q_u16(dst + i + 8, vshll_n_u8(vget_high_u8(s), 8));
+    }
+    image_convert_widen_row_c(dst + i, src + i, n - i);
+}
+#endif
+
+void
+image_convert_nv12_to_p010(uint8_t *dst_y, unsigned int dst_y_pitch,
+                           uint8_t *dst_uv, unsigned int dst_uv_pitch,
+                           const uint8_t *src_y, unsigned int src_y_pitch,
+                           const uint8_t *src_uv, unsigned int src_uv_pitch,
+                           unsigned int width, unsigned int height)
+{
+    unsigned int y;
+
+    for (y = 0; y < height; y++)
+        image_convert_kernels.widen((uint16_t *)(dst_y + (size_t)y * dst_y_pitch),
+                                    src_y + (size_t)y * src_y_pitch, width);
+    for (y = 0; y < (height + 1) / 2; y++)
+        image_convert_kernels.widen((uint16_t *)(dst_uv + (size_t)y * dst_uv_pitch),
+                                    src_uv + (size_t)y * src_uv_pitch, (width + 1) & ~1u);
+}
+
+void
+image_convert_nv15_to_p010_row_c(uint16_t *dst, const uint8_t *src, unsigned int n)
+{
+    unsigned int i;
+
+    for (i = 0; i < n; i += 4, src += 5) {
+        dst[i]     = (src[0] | (src[1] & 0x03) << 8) << 6;
+        dst[i + 1] = (src[1] >> 2 | (src[2] & 0x0f) << 6) << 6;
+        dst[i + 2] = (src[2] >> 4 | (src[3] & 0x3f) << 4) << 6;
+        dst[i + 3] = (src[3] >> 6 | src[4] << 2) << 6;
+    }
+}
+
+#if defined(IMAGE_CONVERT_X86)
+static IMAGE_CONVERT_TARGET_ssse3 void
+image_convert_nv15_to_p010_row_ssse3(uint16_t *dst, const uint8_t *src, unsigned int n)
+{
+    /* Gather each sample's two bytes, align its bits to the top, mask */
+    const __m128i gather = _mm_setr_epi8(NV15_GATHER);
+    const __m128i scale = _mm_setr_epi16(64, 16, 4, 1, 64, 16, 4, 1);
+    const __m128i mask = _mm_set1_epi16((short)0xffc0);
+    unsigned int i;
+
+    /* Sixteen byte loads of ten byte groups, stay clear of the row end */
+    for (i = 0; i + 16 <= n; i += 8, src += 10) {
+        __m128i words = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)src), gather);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_and_si128(_mm_mullo_epi16(words, scale), mask));
+    }
+    image_convert_nv15_to_p010_row_c(dst + i, src, n - i);
+}
+#elif defined(__aarch64__)
+static void
+image_convert_nv15_to_p010_row_neon(uint16_t *dst, const uint8_t *src, unsigned int n)
+{
+    static const uint8_t gather_table[16] = { NV15_GATHER };
+    static const int16_t shift_table[8] = { 6, 4, 2, 0, 6, 4, 2, 0 };
+    const uint8x16_t gather = vld1q_u8(gather_table);
+    const int16x8_t shift = vld1q_s16(shift_table);
+    const uint16x8_t mask = vdupq_n_u16(0xffc0);
+    unsigned int i;
+
+    for (i = 0; i + 16 <= n; i += 8, src += 10) {
+        uint16x8_t words = vreinterpretq_u16_u8(vqtbl1q_u8(vld1q_u8(src), gather));
+        vst1q_u16(dst + i, vandq_u16(vshlq_u16(words, shift), mask));
+    }
+    image_convert_nv15_to_p010_row_c(dst + i, src, n - i);
+}
+#endif
+
+void
+image_convert_nv15_to_p010_row(uint16_t *dst, const uint8_t *src, unsigned int n)
+{
+    image_convert_kernels.nv15_to_p010(dst, src, n);
+}
+
+void
+image_convert_p010_to_nv15_row_c(uint8_t *dst, const uint16_t *src, unsigned int n)
+{
+    unsigned int i;
+
+    for (i = 0; i < n; i += 4, dst += 5) {
+        unsigned int v0 = src[i] >> 6, v1 = src[i + 1] >> 6;
+        unsigned int v2 = src[i + 2] >> 6, v3 = src[i + 3] >> 6;
+
+        dst[0] = v0;
+        dst[1] = v0 >> 8 | v1 << 2;
+        dst[2] = v1 >> 6 | v2 << 4;
+        dst[3] = v2 >> 4 | v3 << 6;
+        dst[4] = v3 >> 2;
+    }
+}
+
+#if defined(IMAGE_CONVERT_X86)
+static IMAGE_CONVERT_TARGET_ssse3 void
+image_convert_p010_to_nv15_row_ssse3(uint8_t *dst, const uint16_t *src, unsigned int n)
+{
+    /* Shift each sample to its bit position, then merge the byte halves */
+    const __m128i scale = _mm_setr_epi16(1, 4, 16, 64, 1, 4, 16, 64);
+    const __m128i lo = _mm_setr_epi8(NV15_SCATTER_LO);
+    const __m128i hi = _mm_setr_epi8(NV15_SCATTER_HI);
+    unsigned int i;
+
+    for (i = 0; i + 8 <= n; i += 8, dst += 10) {
+        __m128i words = _mm_mullo_epi16(_mm_srli_epi16(_mm_loadu_si128((const __m128i *)(src + i)), 6), scale);
+        __m128i bytes = _mm_or_si128(_mm_shuffle_epi8(words, lo), _mm_shuffle_epi8(words, hi));
+        uint16_t tail = _mm_extract_epi16(bytes, 4);
+
+        /* Exactly ten bytes, the next group may belong to another band */
+        _mm_storel_epi64((__m128i *)dst, bytes);
+        memcpy(dst + 8, &tail, sizeof(tail));
+    }
+    image_convert_p010_to_nv15_row_c(dst, src + i, n - i);
+}
+#elif defined(__aarch64__)
+static void
+image_convert_p010_to_nv15_row_neon(uint8_t *dst, const uint16_t *src, unsigned int n)
+{
+    static const int8_t lo_table[16] = { NV15_SCATTER_LO };
+    static const int8_t hi_table[16] = { NV15_SCATTER_HI };
+    static const int16_t shift_table[8] = { 0, 2, 4, 6, 0, 2, 4, 6 };
+    const uint8x16_t lo = vreinterpretq_u8_s8(vld1q_s8(lo_table));
+    const uint8x16_t hi = vreinterpretq_u8_s8(vld1q_s8(hi_table));
+    const int16x8_t shift = vld1q_s16(shift_table);
+    unsigned int i;
+
+    for (i = 0; i + 8 <= n; i += 8, dst += 10) {
+        uint8x16_t words = vreinterpretq_u8_u16(vshlq_u16(vshrq_n_u16(vld1q_u16(src + i), 6), shift));
+        uint8x16_t bytes = vorrq_u8(vqtbl1q_u8(words, lo), vqtbl1q_u8(words, hi));
+        vst1_u8(dst, vget_low_u8(bytes));
+        vst1q_lane_u16((uint16_t *)(dst + 8), vreinterpretq_u16_u8(bytes), 4);
+    }
+    image_convert_p010_to_nv15_row_c(dst, src + i, n - i);
+}
+#endif
+
+void
+image_convert_p010_to_nv15_row(uint8_t *dst, const uint16_t *src, unsigned int n)
+{
+    image_convert_kernels.p010_to_nv15(dst, src, n);
+}
+
+void
+image_convert_nv15_to_p010(uint8_t *dst_y, unsigned int dst_y_pitch,
+                           uint8_t *dst_uv, unsigned int dst_uv_pitch,
+                           const uint8_t *src_y, unsigned int src_y_pitch,
+                           const uint8_t *src_uv, unsigned int src_uv_pitch,
+                           unsigned int width, unsigned int height)
+{
+    unsigned int y;
+
+    for (y = 0; y < height; y++)
+        image_convert_nv15_to_p010_row((uint16_t *)(dst_y + (size_t)y * dst_y_pitch),
+                                       src_y + (size_t)y * src_y_pitch, width);
+    for (y = 0; y < (height + 1) / 2; y++)
+        image_convert_nv15_to_p010_row((uint16_t *)(dst_uv + (size_t)y * dst_uv_pitch),
+                                       src_uv + (size_t)y * src_uv_pitch, width);
+}
+
+void
+image_convert_p010_to_nv15(uint8_t *dst_y, unsigned int dst_y_pitch,
+                           uint8_t *dst_uv, unsigned int dst_uv_pitch,
+                           const uint8_t *src_y, unsigned int src_y_pitch,
+                           const uint8_t *src_uv, unsigned int src_uv_pitch,
+                           unsigned int width, unsigned int height)
+{
+    unsigned int y;
+
+    for (y = 0; y < height; y++)
+        image_convert_p010_to_nv15_row(dst_y + (size_t)y * dst_y_pitch,
+                                       (const uint16_t *)(src_y + (size_t)y * src_y_pitch), width);
+    for (y = 0; y < (height + 1) / 2; y++)
+        image_convert_p010_to_nv15_row(dst_uv + (size_t)y * dst_uv_pitch,
+                                       (const uint16_t *)(src_uv + (size_t)y * src_uv_pitch), width);
+}
+
+/* Copies [x, x + width) of line y of a tiled plane */
+static void
+image_convert_detile_line(uint8_t *dst, const uint8_t *src, unsigned int src_pitch,
+                          unsigned int tile_width, unsigned int tile_height,
+                          unsigned int x, unsigned int y, unsigned int width)
+{
+    const uint8_t *line = src + (size_t)(y / tile_height) * tile_height * src_pitch +
+                          (y % tile_height) * tile_width;
+    const unsigned int end = x + width;
+    unsigned int n;
+
+    for (; x < end; x += n, dst += n) {
+        n = tile_width - x % tile_width;
+        if (n > end - x)
+            n = end - x;
+        memcpy(dst, line + (size_t)(x / tile_width) * tile_width * tile_height + x % tile_width, n);
+    }
+}
+
+void
+image_convert_detile_plane_c(uint8_t *dst, unsigned int dst_pitch,
+                             const uint8_t *src, unsigned int src_pitch,
+                             unsigned int tile_width, unsigned int tile_height,
+                             unsigned int x, unsigned int y,
+                             unsigned int width, unsigned int height)
+{
+    unsigned int i;
+
+    for (i = 0; i < height; i++)
+        image_convert_detile_line(dst + (size_t)i * dst_pitch, src, src_pitch,
+                                  tile_width, tile_height, x, y + i, width);
+}
+
+#if defined(IMAGE_CONVERT_X86) || defined(__ARM_NEON)
+/* Tiles i to n, which the block loops left over, src at tile i */
+static void
+image_convert_detile_rest(uint8_t *dst, unsigned int dst_pitch, const uint8_t *src,
+                          unsigned int tile_width, unsigned int tile_height,
+                          unsigned int i, unsigned int n)
+{
+    unsigned int l;
+
+    for (; i < n; i++, src += tile_width * tile_height)
+        for (l = 0; l < tile_height; l++)
+            memcpy(dst + (size_t)l * dst_pitch + i * tile_width, src + l * tile_width, tile_width);
+}
+#endif
+
+/*
+ * Unpacks lines [first_line, first_line + num_lines) of n whole tiles of
+ * one tile row. Returns 0 when there is no vector kernel for the tile
+ * size; 4 byte wide tiles are only done whole. Without vector support
+ * there is no kernel at all and every tile goes through the scalar path.
+ */
+#if defined(IMAGE_CONVERT_X86)
+static IMAGE_CONVERT_TARGET_sse2 int
+image_convert_detile_tiles_sse2(uint8_t *dst, unsigned int dst_pitch, const uint8_t *src,
+                                unsigned int tile_width, unsigned int tile_height,
+                                unsigned int first_line, unsigned int num_lines, unsigned int n)
+{
+    unsigned int i = 0, l;
+
+    if (16 == tile_width) {
+        /* Every tile line already is a linear run of 16 bytes */
+        for (src += first_line * 16; i < n; i++, src += 16 * tile_height)
+            for (l = 0; l < num_lines; l++)
+                _mm_storeu_si128((__m128i *)(dst + (size_t)l * dst_pitch + i * 16),
+                                 _mm_loadu_si128((const __m128i *)(src + l * 16)));
+        return 1;
+    }
+    if (4 != tile_width || num_lines != tile_height || (4 != tile_height && 2 != tile_height))
+        return 0;
+
+    if (4 == tile_height) {
+        /* A 4x4 transpose of 32 bit words turns four tiles into four lines */
+        for (; i + 4 <= n; i += 4, src += 64) {
+            __m128i a = _mm_loadu_si128((const __m128i *)src);
+            __m128i b = _mm_loadu_si128((const __m128i *)(src + 16));
+            __m128i c = _mm_loadu_si128((const __m128i *)(src + 32));
+            __m128i d = _mm_loadu_si128((const __m128i *)(src + 48));
+            __m128i ab_lo = _mm_unpacklo_epi32(a, b), ab_hi = _mm_unpackhi_epi32(a, b);
+            __m128i cd_lo = _mm_unpacklo_epi32(c, d), cd_hi = _mm_unpackhi_epi32(c, d);
+
+            _mm_storeu_si128((__m128i *)(dst + i * 4), _mm_unpacklo_epi64(ab_lo, cd_lo));
+            _mm_storeu_si128((__m128i *)(dst + dst_pitch + i * 4), _mm_unpackhi_epi64(ab_lo, cd_lo));
+            _mm_storeu_si128((__m128i *)(dst + 2 * (size_t)dst_pitch + i * 4), _mm_unpacklo_epi64(ab_hi, cd_hi));
+            _mm_storeu_si128((__m128i *)(dst + 3 * (size_t)dst_pitch + i * 4), _mm_unpackhi_epi64(ab_hi, cd_hi));
+        }
+    } else {
+        for (; i + 4 <= n; i += 4, src += 32) {
+            __m128i a = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)src), _MM_SHUFFLE(3, 1, 2, 0));
+            __m128i b = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(src + 16)), _MM_SHUFFLE(3, 1, 2, 0));
+
+            _mm_storeu_si128((__m128i *)(dst + i * 4), _mm_unpacklo_epi64(a, b));
+            _mm_storeu_si128((__m128i *)(dst + dst_pitch + i * 4), _mm_unpackhi_epi64(a, b));
+        }
+    }
+    image_convert_detile_rest(dst, dst_pitch, src, 4, tile_height, i, n);
+    return 1;
+}
+#elif defined(__ARM_NEON)
+static int
+image_convert_detile_tiles_neon(uint8_t *dst, unsigned int dst_pitch, const uint8_t *src,
+                                unsigned int tile_width, unsigned int tile_height,
+                                unsigned int first_line, unsigned int num_lines, unsigned int n)
+{
+    unsigned int i = 0, l;
+
+    if (16 == tile_width) {
+        for (src += first_line * 16; i < n; i++, src += 16 * tile_height)
+            for (l = 0; l < num_lines; l++)
+                vst1q_u8(dst + (size_t)l * dst_pitch + i * 16, vld1q_u8(src + l * 16));
+        return 1;
+    }
+    if (4 != tile_width || num_lines != tile_height || (4 != tile_height && 2 != tile_height))
+        return 0;
+
+    if (4 == tile_height) {
+        /* De-interleaving loads put line l of four tiles in one register */
+        for (; i + 4 <= n; i += 4, src += 64) {
+            uint32x4x4_t t = vld4q_u32((const uint32_t *)src);
+
+            for (l = 0; l < 4; l++)
+                vst1q_u8(dst + (size_t)l * dst_pitch + i * 4, vreinterpretq_u8_u32(t.val[l]));
+        }
+    } else {
+        for (; i + 4 <= n; i += 4, src += 32) {
+            uint32x4x2_t t = vld2q_u32((const uint32_t *)src);
+
+            vst1q_u8(dst + i * 4, vreinterpretq_u8_u32(t.val[0]));
+            vst1q_u8(dst + dst_pitch + i * 4, vreinterpretq_u8_u32(t.val[1]));
+        }
+    }
+    image_convert_detile_rest(dst, dst_pitch, src, 4, tile_height, i, n);
+    return 1;
+}
+#endif
+
+void
+image_convert_tile_plane(uint8_t *dst, unsigned int dst_pitch,
+                         const uint8_t *src, unsigned int src_pitch,
+                         unsigned int tile_width, unsigned int tile_height,
+                         unsigned int y, unsigned int width, unsigned int height)
+{
+    unsigned int row, x;
+    uint8_t *line;
+
+    for (row = y; row < y + height; row++, src += src_pitch) {
+        line = dst + (size_t)(row / tile_height) * tile_height * dst_pitch + (row % tile_height) * tile_width;
+        for (x = 0; x < width; x += tile_width)
+            memcpy(line + (size_t)x * tile_height, src + x, tile_width);
+    }
+}
+
+void
+image_convert_detile_plane(uint8_t *dst, unsigned int dst_pitch,
+                           const uint8_t *src, unsigned int src_pitch,
+                           unsigned int tile_width, unsigned int tile_height,
+                           unsigned int x, unsigned int y,
+                           unsigned int width, unsigned int height)
+{
+    const unsigned int first = (x + tile_width - 1) / tile_width;
+    const unsigned int last = (x + width) / tile_width;
+    const unsigned int end = y + height;
+    unsigned int row, line, n, l;
+
+    for (row = y; row < end; row += n, dst += (size_t)n * dst_pitch) {
+        line = row % tile_height;
+        n = tile_height - line;
+        if (n > end - row)
+            n = end - row;
+
+        /* Whole tiles go to the vector kernel, the edges line by line */
+        if (first < last && image_convert_kernels.detile_tiles &&
+            image_convert_kernels.detile_tiles(dst + first * tile_width - x, dst_pitch,
+                                               src + (size_t)(row - line) * src_pitch +
+                                               (size_t)first * tile_width * tile_height,
+                                               tile_width, tile_height, line, n, last - first)) {
+            for (l = 0; l < n; l++) {
+                image_convert_detile_line(dst + (size_t)l * dst_pitch, src, src_pitch,
+                                          tile_width, tile_height, x, row + l, first * tile_width - x);
+                image_convert_detile_line(dst + (size_t)l * dst_pitch + last * tile_width - x, src, src_pitch,
+                                          tile_width, tile_height, last * tile_width, row + l,
+                                          x + width - last * tile_width);
+            }
+            continue;
+        }
+        image_convert_detile_plane_c(dst, dst_pitch, src, src_pitch,
+                                     tile_width, tile_height, x, row, width, n);
+    }
+}
+
+/*
+ * 2:1 box filter of two lines of adjacent samples into n outputs, the
+ * common case of a luma or planar chroma downscale
+ */
+static void
+image_convert_box2_row_c(uint8_t *dst, const uint8_t *src0, const uint8_t *src1, unsigned int n)
+{
+    unsigned int i;
+
+    for (i = 0; i < n; i++)
+        dst[i] = (src0[2 * i] + src0[2 * i + 1] + src1[2 * i] + src1[2 * i + 1] + 2) >> 2;
+}
+
+#if defined(IMAGE_CONVERT_X86)
+static IMAGE_CONVERT_TARGET_avx2 void
+image_convert_box2_row_avx2(uint8_t *dst, const uint8_t *src0, const uint8_t *src1, unsigned int n)
+{
+    const __m256i mask = _mm256_set1_epi16(0x00ff);
+    const __m256i round = _mm256_set1_epi16(2);
+    unsigned int i;
+
+    for (i = 0; i + 32 <= n; i += 32) {
+        __m256i a0 = _mm256_loadu_si256((const __m256i *)(src0 + 2 * i));
+        __m256i a1 = _mm256_loadu_si256((const __m256i *)(src0 + 2 * i + 32));
+        __m256i b0 = _mm256_loadu_si256((const __m256i *)(src1 + 2 * i));
+        __m256i b1 = _mm256_loadu_si256((const __m256i *)(src1 + 2 * i + 32));
+        __m256i s0 = _mm256_add_epi16(_mm256_add_epi16(_mm256_and_si256(a0, mask), _mm256_srli_epi16(a0, 8)),
+                                      _mm256_add_epi16(_mm256_and_si256(b0, mask), _mm256_srli_epi16(b0, 8)));
+        __m256i s1 = _mm256_add_epi16(_mm256_add_epi16(_mm256_and_si256(a1, mask), _mm256_srli_epi16(a1, 8)),
+                                      _mm256_add_epi16(_mm256_and_si256(b1, mask), _mm256_srli_epi16(b1, 8)));
+
+        s0 = _mm256_srli_epi16(_mm256_add_epi16(s0, round), 2);
+        s1 = _mm256_srli_epi16(_mm256_add_epi16(s1, round), 2);
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_permute4x64_epi64(_mm256_packus_epi16(s0, s1), 0xd8));
+    }
+    image_convert_box2_row_c(dst + i, src0 + 2 * i, src1 + 2 * i, n - i);
+}
+
+static IMAGE_CONVERT_TARGET_sse2 void
+image_convert_box2_row_sse2(uint8_t *dst, const uint8_t *src0, const uint8_t *src1, unsigned int n)
+{
+    const __m128i mask = _mm_set1_epi16(0x00ff);
+    const __m128i round = _mm_set1_epi16(2);
+    unsigned int i;
+
+    /* Even and odd bytes as 16 bit words, summed over both lines */
+    for (i = 0; i + 16 <= n; i += 16) {
+        __m128i a0 = _mm_loadu_si128((const __m128i *)(src0 + 2 * i));
+        __m128i a1 = _mm_loadu_si128((const __m128i *)(src0 + 2 * i + 16));
+        __m128i b0 = _mm_loadu_si128((const __m128i *)(src1 + 2 * i));
+        __m128i b1 = _mm_loadu_si128((const __m128i *)(src1 + 2 * i + 16));
+        __m128i s0 = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a0, mask), _mm_srli_epi16(a0, 8)),
+                                   _mm_add_epi16(_mm_and_si128(b0, mask), _mm_srli_epi16(b0, 8)));
+        __m128i s1 = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a1, mask), _mm_srli_epi16(a1, 8)),
+                                   _mm_add_epi16(_mm_and_si128(b1, mask), _mm_srli_epi16(b1, 8)));
+
+        s0 = _mm_srli_epi16(_mm_add_epi16(s0, round), 2);
+        s1 = _mm_srli_epi16(_mm_add_epi16(s1, round), 2);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(s0, s1));
+    }
+    image_convert_box2_row_c(dst + i, src0 + 2 * i, src1 + 2 * i, n - i);
+}
+#elif defined(__ARM_NEON)
+static void
+image_convert_box2_row_neon(uint8_t *dst, const uint8_t *src0, const uint8_t *src1, unsigned int n)
+{
+    unsigned int i;
+
+    /* Pairwise widening adds, then a rounding narrow */
+    for (i = 0; i + 16 <= n; i += 16) {
+        uint16x8_t s0 = vpadalq_u8(vpaddlq_u8(vld1q_u8(src0 + 2 * i)), vld1q_u8(src1 + 2 * i));
+        uint16x8_t s1 = vpadalq_u8(vpaddlq_u8(vld1q_u8(src0 + 2 * i + 16)), vld1q_u8(src1 + 2 * i + 16));
+
+        vst1q_u8(dst + i, vcombine_u8(vrshrn_n_u16(s0, 2), vrshrn_n_u16(s1, 2)));
+    }
+    image_convert_box2_row_c(dst + i, src0 + 2 * i, src1 + 2 * i, n - i);
+}
+#endif
+
+/*
+ * Averages (1 << shift) square blocks
+ */
+static void
+image_convert_box_plane(uint8_t *dst, unsigned int dst_pitch, unsigned int dst_step,
+                        const uint8_t *src, unsigned int src_pitch, unsigned int src_step,
+                        unsigned int dst_width, unsigned int first_row, unsigned int num_rows,
+                        unsigned int shift)
+{
+    const unsigned int factor = 1u << shift;
+    const unsigned int round = 1u << (2 * shift - 1);
+    unsigned int x, y, i, j;
+
+    if (1 == shift && 1 == src_step && 1 == dst_step) {
+        for (y = first_row; y < first_row + num_rows; y++)
+            image_convert_kernels.box2(dst + (size_t)y * dst_pitch,
+                                       src + (size_t)(2 * y) * src_pitch,
+                                       src + (size_t)(2 * y + 1) * src_pitch, dst_width);
+        return;
+    }
+
+    for (y = first_row; y < first_row + num_rows; y++) {
+        const uint8_t *s = src + (size_t)(y << shift) * src_pitch;
+        uint8_t *d = dst + (size_t)y * dst_pitch;
+
+        for (x = 0; x < dst_width; x++) {
+            const uint8_t *b = s + (size_t)(x << shift) * src_step;
+            unsigned int sum = 0;
+
+            for (j = 0; j < factor; j++)
+                for (i = 0; i < factor; i++)
+                    sum += b[(size_t)j * src_pitch + i * src_step];
+            d[x * dst_step] = (sum + round) >> (2 * shift);
+        }
+    }
+}
+
+/*
+ * Source position of the centre of output sample i, 16.16 fixed point,
+ * clamped so that the sample and its right neighbour are both inside.
+ */
+static inline unsigned int
+image_convert_source_pos(unsigned int i, unsigned int src_size, unsigned int dst_size)
+{
+    int64_t pos = (((int64_t)(2 * i + 1) * src_size << 16) / (2 * dst_size)) - 0x8000;
+
+    if (pos < 0)
+        return 0;
+    if (pos > (int64_t)(src_size - 1) << 16)
+        return (src_size - 1) << 16;
+    return pos;
+}
+
+static void
+image_convert_bilinear_plane(uint8_t *dst, unsigned int dst_pitch, unsigned int dst_step,
+                             const uint8_t *src, unsigned int src_pitch, unsigned int src_step,
+                             unsigned int src_width, unsigned int src_height,
+                             unsigned int dst_width, unsigned int dst_height,
+                             unsigned int first_row, unsigned int num_rows)
+{
+    unsigned int x, y;
+
+    for (y = first_row; y < first_row + num_rows; y++) {
+        unsigned int fy = image_convert_source_pos(y, src_height, dst_height);
+        unsigned int y0 = fy >> 16;
+        unsigned int y1 = y0 + 1 < src_height ? y0 + 1 : y0;
+        unsigned int wy = (fy >> 8) & 0xff;
+        const uint8_t *r0 = src + (size_t)y0 * src_pitch;
+        const uint8_t *r1 = src + (size_t)y1 * src_pitch;
+        uint8_t *d = dst + (size_t)y * dst_pitch;
+
+        for (x = 0; x < dst_width; x++) {
+            unsigned int fx = image_convert_source_pos(x, src_width, dst_width);
+            unsigned int x0 = fx >> 16;
+            unsigned int x1 = x0 + 1 < src_width ? x0 + 1 : x0;
+            unsigned int wx = (fx >> 8) & 0xff;
+            unsigned int top = r0[x0 * src_step] * (256 - wx) + r0[x1 * src_step] * wx;
+            unsigned int bottom = r1[x0 * src_step] * (256 - wx) + r1[x1 * src_step] * wx;
+
+            d[x * dst_step] = (top * (256 - wy) + bottom * wy + 0x8000) >> 16;
+        }
+    }
+}
+
+void
+image_convert_scale_plane(uint8_t *dst, unsigned int dst_pitch, unsigned int dst_step,
+                          const uint8_t *src, unsigned int src_pitch, unsigned int src_step,
+                          unsigned int src_width, unsigned int src_height,
+                          unsigned int dst_width, unsigned int dst_height,
+                          unsigned int first_row, unsigned int num_rows)
+{
+    unsigned int shift;
+
+    if (first_row >= dst_height)
+        return;
+    if (num_rows > dst_height - first_row)
+        num_rows = dst_height - first_row;
+
+    for (shift = 1; shift <= 3; shift++) {
+        if (src_width == dst_width << shift && src_height == dst_height << shift) {
+            image_convert_box_plane(dst, dst_pitch, dst_step, src, src_pitch, src_step,
+                                    dst_width, first_row, num_rows, shift);
+            return;
+        }
+    }
+    image_convert_bilinear_plane(dst, dst_pitch, dst_step, src, src_pitch, src_step,
+                                 src_width, src_height, dst_width, dst_height,
+                                 first_row, num_rows);
+}
+
+void
+image_convert_init(unsigned int features)
+{
+    image_convert_kernels.deinterleave = image_convert_deinterleave_c;
+    image_convert_kernels.interleave = image_convert_interleave_c;
+    image_convert_kernels.read_uncached = image_convert_read_uncached_c;
+    image_convert_kernels.nv12_to_yuy2 = image_convert_nv12_to_yuy2_row_c;
+    image_convert_kernels.nv12_to_uyvy = image_convert_nv12_to_uyvy_row_c;
+    image_convert_kernels.nv12_to_rgbx = image_convert_nv12_to_rgbx_row_c;
+    image_convert_kernels.nv12_to_bgrx = image_convert_nv12_to_bgrx_row_c;
+    image_convert_kernels.widen = image_convert_widen_row_c;
+    image_convert_kernels.nv15_to_p010 = image_convert_nv15_to_p010_row_c;
+    image_convert_kernels.p010_to_nv15 = image_convert_p010_to_nv15_row_c;
+    image_convert_kernels.detile_tiles = NULL;
+    image_convert_kernels.box2 = image_convert_box2_row_c;
+
+#if defined(IMAGE_CONVERT_X86)
+    if (features & CPU_FEATURE_SSE2) {
+        image_convert_kernels.deinterleave = image_convert_deinterleave_sse2;
+        image_convert_kernels.interleave = image_convert_interleave_sse2;
+        image_convert_kernels.read_uncached = image_convert_read_uncached_sse2;
+        image_convert_kernels.nv12_to_yuy2 = image_convert_nv12_to_yuy2_row_sse2;
+        image_convert_kernels.nv12_to_uyvy = image_convert_nv12_to_uyvy_row_sse2;
+        image_convert_kernels.nv12_to_rgbx = image_convert_nv12_to_rgbx_row_sse2;
+        image_convert_kernels.nv12_to_bgrx = image_convert_nv12_to_bgrx_row_sse2;
+        image_convert_kernels.widen = image_convert_widen_row_sse2;
+        image_convert_kernels.detile_tiles = image_convert_detile_tiles_sse2;
+        image_convert_kernels.box2 = image_convert_box2_row_sse2;
+    }
+    if (features & CPU_FEATURE_SSSE3) {
+        image_convert_kernels.nv15_to_p010 = image_convert_nv15_to_p010_row_ssse3;
+        image_convert_kernels.p010_to_nv15 = image_convert_p010_to_nv15_row_ssse3;
+    }
+    if (features & CPU_FEATURE_SSE4_1)
+        image_convert_kernels.read_uncached = image_convert_read_uncached_sse41;
+    if (features & CPU_FEATURE_AVX2) {
+        image_convert_kernels.deinterleave = image_convert_deinterleave_avx2;
+        image_convert_kernels.interleave = image_convert_interleave_avx2;
+        image_convert_kernels.nv12_to_yuy2 = image_convert_nv12_to_yuy2_row_avx2;
+        image_convert_kernels.nv12_to_uyvy = image_convert_nv12_to_uyvy_row_avx2;
+        image_convert_kernels.nv12_to_rgbx = image_convert_nv12_to_rgbx_row_avx2;
+        image_convert_kernels.nv12_to_bgrx = image_convert_nv12_to_bgrx_row_avx2;
+        image_convert_kernels.widen = image_convert_widen_row_avx2;
+        image_convert_kernels.box2 = image_convert_box2_row_avx2;
+    }
+#elif defined(__ARM_NEON)
+    if (features & CPU_FEATURE_NEON) {
+        image_convert_kernels.deinterleave = image_convert_deinterleave_neon;
+        image_convert_kernels.interleave = image_convert_interleave_neon;
+        image_convert_kernels.nv12_to_yuy2 = image_convert_nv12_to_yuy2_row_neon;
+        image_convert_kernels.nv12_to_uyvy = image_convert_nv12_to_uyvy_row_neon;
+        image_convert_kernels.nv12_to_rgbx = image_convert_nv12_to_rgbx_row_neon;
+        image_convert_kernels.nv12_to_bgrx = image_convert_nv12_to_bgrx_row_neon;
+        image_convert_kernels.widen = image_convert_widen_row_neon;
+        image_convert_kernels.detile_tiles = image_convert_detile_tiles_neon;
+        image_convert_kernels.box2 = image_convert_box2_row_neon;
+#if defined(__aarch64__)
+        image_convert_kernels.read_uncached = image_convert_read_uncached_neon;
+        image_convert_kernels.nv15_to_p010 = image_convert_nv15_to_p010_row_neon;
+        image_convert_kernels.p010_to_nv15 = image_convert_p010_to_nv15_row_neon;
+#endif
+    }
+#endif
+}
@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2015 - 2016 Rockchip Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef IMAGE_CONVERT_H
+#define IMAGE_CONVERT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Readback kernels from surface frames into VAImage layouts. The vector
+ * variants (AVX2, SSE4.1, SSSE3, SSE2 or NEON) are chosen at run time,
+ * the scalar kernels are reference and fallback.
+ */
+
+/*
+ * Binds every kernel to the best variant for the CPU_FEATURE_* bits in
+ * features, scalar when there are none. Call once before any other
+ * function of this file.
+ */
+void
+image_convert_init(unsigned int features);
+
+/* Cached staging area for readers of uncached memory, on the stack */
+#define IMAGE_CONVERT_BOUNCE_SIZE   (64 * 1024)
+
+/*
+ * Splits n interleaved UV pairs into separate U and V rows.
+ */
+void
+image_convert_deinterleave_c(uint8_t *u, uint8_t *v, const uint8_t *uv, unsigned int n);
+
+void
+image_convert_deinterleave(uint8_t *u, uint8_t *v, const uint8_t *uv, unsigned int n);
+
+/*
+ * Merges n U and V samples into interleaved UV pairs.
+ */
+void
+image_convert_interleave_c(uint8_t *uv, const uint8_t *u, const uint8_t *v, unsigned int n);
+
+void
+image_convert_interleave(uint8_t *uv, const uint8_t *u, const uint8_t *v, unsigned int n);
+
+/*
+ * Copies a width x height plane between pitched layouts.
+ */
+void
+image_convert_copy_plane(uint8_t *dst, unsigned int dst_pitch,
+                         const uint8_t *src, unsigned int src_pitch,
+                         unsigned int width, unsigned int height);
+
+/*
+ * Copies out of uncached or write-combined memory, where every plain
+ * load is a bus transaction: wide streaming loads (MOVNTDQA, LDNP) with
+ * software prefetch. dst should be cached, typically a bounce buffer
+ * the other kernels then work from.
+ */
+void
+image_convert_read_uncached(uint8_t *dst, const uint8_t *src, size_t size);
+
+void
+image_convert_read_plane_uncached(uint8_t *dst, unsigned int dst_pitch,
+                                  const uint8_t *src, unsigned int src_pitch,
+                                  unsigned int width, unsigned int height);
+
+/*
+ * NV12 to three plane 4:2:0. The caller passes the U and V destinations
+ * in the order of the target fourcc, so this covers both I420 and YV12.
+ * width and height are in luma samples.
+ */
+void
+image_convert_nv12_to_yuv420(uint8_t *dst_y, unsigned int dst_y_pitch,
+                             uint8_t *dst_u, unsigned int dst_u_pitch,
+                             uint8_t *dst_v, unsigned int dst_v_pitch,
+                             const uint8_t *src_y, unsigned int src_y_pitch,
+                             const uint8_t *src_uv, unsigned int src_uv_pitch,
+                             unsigned int width, unsigned int height);
+
+/*
+ * Three plane 4:2:0 to NV12, the inverse of the above.
+ */
+void
+image_convert_yuv420_to_nv12(uint8_t *dst_y, unsigned int dst_y_pitch,
+                             uint8_t *dst_uv, unsigned int dst_uv_pitch,
+                             const uint8_t *src_y, unsigned int src_y_pitch,
+                             const uint8_t *src_u, unsigned int src_u_pitch,
+                             const uint8_t *src_v, unsigned int src_v_pitch,
+                             unsigned int width, unsigned int height);
+
+/*
+ * NV12 to packed and high bit depth layouts. Each pair has its own row
+ * kernel generated from a macro, with vector variants for the whole
+ * blocks of a row. RGB is BT.601 limited range, P010 carries the 8 bit
+ * samples in its top bits.
+ */
+#define IMAGE_CONVERT_NV12_TO_PACKED(name)                                          \
+void                                                                                \
+image_convert_nv12_to_##name(uint8_t *dst, unsigned int dst_pitch,                  \
+                             const uint8_t *src_y, unsigned int src_y_pitch,        \
+                             const uint8_t *src_uv, unsigned int src_uv_pitch,      \
+                             unsigned int width, unsigned int height)
+
+IMAGE_CONVERT_NV12_TO_PACKED(yuy2);
+IMAGE_CONVERT_NV12_TO_PACKED(uyvy);
+IMAGE_CONVERT_NV12_TO_PACKED(rgbx);
+IMAGE_CONVERT_NV12_TO_PACKED(bgrx);
+
+void
+image_convert_nv12_to_p010(uint8_t *dst_y, unsigned int dst_y_pitch,
+                           uint8_t *dst_uv, unsigned int dst_uv_pitch,
+                           const uint8_t *src_y, unsigned int src_y_pitch,
+                           const uint8_t *src_uv, unsigned int src_uv_pitch,
+                           unsigned int width, unsigned int height);
+
+/*
+ * NV15 packs four 10 bit samples into five bytes, least significant bits
+ * first. P010 holds each sample in the top bits of a 16 bit word. n is
+ * in samples and a multiple of four; an NV15 row is (n * 10 + 7) / 8
+ * bytes.
+ */
+void
+image_convert_nv15_to_p010_row_c(uint16_t *dst, const uint8_t *src, unsigned int n);
+
+void
+image_convert_nv15_to_p010_row(uint16_t *dst, const uint8_t *src, unsigned int n);
+
+void
+image_convert_p010_to_nv15_row_c(uint8_t *dst, const uint16_t *src, unsigned int n);
+
+void
+image_convert_p010_to_nv15_row(uint8_t *dst, const uint16_t *src, unsigned int n);
+
+/*
+ * Converts a width x height 4:2:0 frame between NV15 and P010, the
+ * interleaved chroma planes included.
+ */
+void
+image_convert_nv15_to_p010(uint8_t *dst_y, unsigned int dst_y_pitch,
+                           uint8_t *dst_uv, unsigned int dst_uv_pitch,
+                           const uint8_t *src_y, unsigned int src_y_pitch,
+                           const uint8_t *src_uv, unsigned int src_uv_pitch,
+                           unsigned int width, unsigned int height);
+
+void
+image_convert_p010_to_nv15(uint8_t *dst_y, unsigned int dst_y_pitch,
+                           uint8_t *dst_uv, unsigned int dst_uv_pitch,
+                           const uint8_t *src_y, unsigned int src_y_pitch,
+                           const uint8_t *src_uv, unsigned int src_uv_pitch,
+                           unsigned int width, unsigned int height);
+
+/*
+ * Tiled planes store tile_width x tile_height byte blocks back to back,
+ * each block line by line and a tile row of blocks left to right, so a
+ * tile row spans tile_height lines of pitch bytes. Copies the width x
+ * height rect at (x, y) of such a plane into a linear one. The vector
+ * path covers whole 4x4, 4x2 and 16 byte wide tiles, the rest goes
+ * through the scalar reference.
+ */
+void
+image_convert_detile_plane_c(uint8_t *dst, unsigned int dst_pitch,
+                             const uint8_t *src, unsigned int src_pitch,
+                             unsigned int tile_width, unsigned int tile_height,
+                             unsigned int x, unsigned int y,
+                             unsigned int width, unsigned int height);
+void
+image_convert_detile_plane(uint8_t *dst, unsigned int dst_pitch,
+                           const uint8_t *src, unsigned int src_pitch,
+                           unsigned int tile_width, unsigned int tile_height,
+                           unsigned int x, unsigned int y,
+                           unsigned int width, unsigned int height);
+
+/*
+ * The inverse for whole lines: writes lines [y, y + height) of a linear
+ * plane, src pointing at line y, into the tiled plane dst. width is a
+ * multiple of tile_width. This is how a decoder lays out its output.
+ */
+void
+image_convert_tile_plane(uint8_t *dst, unsigned int dst_pitch,
+                         const uint8_t *src, unsigned int src_pitch,
+                         unsigned int tile_width, unsigned int tile_height,
+                         unsigned int y, unsigned int width, unsigned int height);
+
+/*
+ * Scales a src_width x src_height plane to dst_width x dst_height.
+ * Exact 2:1, 4:1 and 8:1 reductions use a box filter, other ratios,
+ * enlargements included, are bilinear and read only the two source
+ * lines around each output line.
+ * The steps are the byte distances between samples, 2 for one half of
+ * an interleaved chroma plane. Only output rows [first_row, first_row +
+ * num_rows) are produced, so a plane can be scaled in bands.
+ */
+void
+image_convert_scale_plane(uint8_t *dst, unsigned int dst_pitch, unsigned int dst_step,
+                          const uint8_t *src, unsigned int src_pitch, unsigned int src_step,
+                          unsigned int src_width, unsigned int src_height,
+                          unsigned int dst_width, unsigned int dst_height,
+                          unsigned int first_row, unsigned int num_rows);
+
+#endif /* IMAGE_CONVERT_H */
@@ -23,6 +23,9 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <assert.h>
 #include "object_heap.h"
 
@@ -30,6 +33,137 @@
 
 #define LAST_FREE   -1
 #define ALLOCATED   -2
+#define CACHED      -3  /* Free, held in a thread's magazine */
+
+#define LOAD_ACQUIRE(p)         __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(p, v)     __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+#define BITS_PER_WORD   (8 * sizeof(unsigned long))
+
+/*
+ * Each bucket starts with its occupancy word, padded so that the objects
+ * keep malloc alignment, or cache line alignment for OBJECT_HEAP_CACHE_ALIGNED.
+ */
+#define BUCKET_HEADER   16
+
+/* Slots per bucket at least, more if they fit the bucket's last page */
+#define BUCKET_MIN_OBJECTS  16
+
+static inline object_base_p
+object_heap_slot(object_heap_p heap, int i)
+{
+    object_heap_index_p index;
+
+    if (heap->flat_base)
+        return (object_base_p)(heap->flat_base + (size_t)i * heap->object_size);
+
+    index = LOAD_ACQUIRE(&heap->index);
+    return (object_base_p)(index->bucket[i / heap->heap_increment] + heap->bucket_header +
+                           (i % heap->heap_increment) * heap->object_size);
+}
+
+/*
+ * Updates the shared free count. Writers hold the heap mutex; the free
+ * fast path peeks at the count without it.
+ */
+static inline void
+object_heap_add_free(object_heap_p heap, int n)
+{
+    __atomic_store_n(&heap->num_free, heap->num_free + n, __ATOMIC_RELAXED);
+}
+
+/*
+ * Number of slots covered by one occupancy word
+ */
+static inline int
+object_heap_group_size(object_heap_p heap)
+{
+    return heap->flat_base ? BITS_PER_WORD : heap->heap_increment;
+}
+
+/*
+ * Returns the occupancy word covering slot i
+ */
+static inline unsigned long *
+object_heap_occupancy(object_heap_p heap, int i)
+{
+    if (heap->flat_base)
+        return &heap->flat_occupied[i / BITS_PER_WORD];
+
+    return (unsigned long *) LOAD_ACQUIRE(&heap->index)->bucket[i / heap->heap_increment];
+}
+
+/*
+ * Sets or clears the occupancy bit of slot i. Magazine allocations and
+ * frees do this without the heap mutex, hence the atomic update.
+ */
+static inline void
+object_heap_mark(object_heap_p heap, int i, int allocated)
+{
+    unsigned long bit = 1UL << (i % object_heap_group_size(heap));
+
+    if (allocated)
+        __atomic_fetch_or(object_heap_occupancy(heap, i), bit, __ATOMIC_RELAXED);
+    else
+        __atomic_fetch_and(object_heap_occupancy(heap, i), ~bit, __ATOMIC_RELAXED);
+}
+
+/*
+ * Grows the bucket index so it can hold at least num_buckets entries.
+ * The new index is a copy, published with release semantics so that
+ * concurrent lookups see either the old or the new one, both valid.
+ * Return 0 on success, -1 on error
+ */
+static int
+object_heap_grow_index(object_heap_p heap, int num_buckets)
+{
+    object_heap_index_p old_index = heap->index;
+    object_heap_index_p new_index;
+    int old_num_buckets = old_index ? old_index->num_buckets : 0;
+    int new_num_buckets = old_num_buckets ? old_num_buckets * 2 : 8;
+
+    while (new_num_buckets < num_buckets)
+        new_num_buckets *= 2;
+
+    new_index = malloc(sizeof(*new_index) + new_num_buckets * sizeof(void *));
+    if (NULL == new_index) {
+        return -1;
+    }
+
+    new_index->retired = old_index;
+    new_index->num_buckets = new_num_buckets;
+    if (old_num_buckets)
+        memcpy(new_index->bucket, old_index->bucket, old_num_buckets * sizeof(void *));
+
+    STORE_RELEASE(&heap->index, new_index);
+    return 0;
+}
+
+/*
+ * Commits the pages of a flat heap backing slots up to new_heap_size.
+ * Return 0 on success, -1 on error
+ */
+static int
+object_heap_flat_commit(object_heap_p heap, int new_heap_size)
+{
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t needed = (size_t)new_heap_size * heap->object_size;
+
+    if (new_heap_size > OBJECT_HEAP_FLAT_MAX_OBJECTS) {
+        return -1; /* Reservation exhausted */
+    }
+    if (needed <= heap->flat_committed) {
+        return 0;
+    }
+
+    needed = (needed + page_size - 1) & ~(page_size - 1);
+    if (mprotect(heap->flat_base + heap->flat_committed, needed - heap->flat_committed,
+                 PROT_READ | PROT_WRITE)) {
+        return -1;
+    }
+    heap->flat_committed = needed;
+    return 0;
+}
 
 /*
  * Expands the heap
@@ -44,25 +178,34 @@ object_heap_expand(object_heap_p heap)
     int new_heap_size = heap->heap_size + heap->heap_increment;
     int bucket_index = new_heap_size / heap->heap_increment - 1;
 
-    if (bucket_index >= heap->num_buckets) {
-        int new_num_buckets = heap->num_buckets + 8;
-        void **new_bucket;
-
-        new_bucket = realloc(heap->bucket, new_num_buckets * sizeof(void *));
-        if (NULL == new_bucket) {
+    if (heap->flat_base) {
+        if (-1 == object_heap_flat_commit(heap, new_heap_size)) {
             return -1;
         }
+        new_heap_index = heap->flat_base + (size_t)heap->heap_size * heap->object_size;
+    } else {
+        if (NULL == heap->index || bucket_index >= heap->index->num_buckets) {
+            if (-1 == object_heap_grow_index(heap, bucket_index + 1)) {
+                return -1;
+            }
+        }
 
-        heap->num_buckets = new_num_buckets;
-        heap->bucket = new_bucket;
-    }
+        if (bucket_index < heap->bucket_count) {
+            /* Released by a trim, still mapped */
+            new_heap_index = heap->index->bucket[bucket_index];
+        } else {
+            new_heap_index = mmap(NULL, heap->bucket_size, PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (MAP_FAILED == new_heap_index) {
+                return -1; /* Out of memory */
+            }
+            heap->index->bucket[bucket_index] = new_heap_index;
+            heap->bucket_count++;
+        }
 
-    new_heap_index = (void *) malloc(heap->heap_increment * heap->object_size);
-    if (NULL == new_heap_index) {
-        return -1; /* Out of memory */
+        *(unsigned long *) new_heap_index = 0;
+        new_heap_index += heap->bucket_header;
     }
-
-    heap->bucket[bucket_index] = new_heap_index;
     next_free = heap->next_free;
     for (i = new_heap_size; i-- > heap->heap_size;) {
         object_base_p obj = (object_base_p)(new_heap_index + (i - heap->heap_size) * heap->object_size);
@@ -71,36 +214,151 @@ object_heap_expand(object_heap_p heap)
         next_free = i;
     }
     heap->next_free = next_free;
-    heap->heap_size = new_heap_size;
+    object_heap_add_free(heap, heap->heap_increment);
+    /* Publishes the new bucket to lock-free lookups */
+    STORE_RELEASE(&heap->heap_size, new_heap_size);
     return 0; /* Success */
 }
 
+/*
+ * Returns count cached slots of a magazine to the shared free list.
+ * Must be called with the heap mutex held.
+ */
+static void
+object_heap_magazine_spill(object_heap_p heap, object_heap_magazine_p magazine, int count)
+{
+    object_base_p obj;
+
+    while (count-- && magazine->count) {
+        obj = object_heap_slot(heap, magazine->slot[--magazine->count]);
+        ASSERT(obj->next_free == CACHED);
+        STORE_RELEASE(&obj->next_free, heap->next_free);
+        heap->next_free = obj->id & OBJECT_HEAP_ID_MASK;
+        object_heap_add_free(heap, 1);
+    }
+}
+
+/*
+ * Thread exit destructor: hands the cached slots back to the heap.
+ */
+static void
+object_heap_magazine_release(void *data)
+{
+    object_heap_magazine_p magazine = data;
+    object_heap_p heap = magazine->heap;
+    object_heap_magazine_p *link;
+
+    pthread_mutex_lock(&heap->mutex);
+    object_heap_magazine_spill(heap, magazine, OBJECT_HEAP_MAGAZINE_SIZE);
+    for (link = &heap->magazines; *link; link = &(*link)->next) {
+        if (*link == magazine) {
+            *link = magazine->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&heap->mutex);
+    free(magazine);
+}
+
+/*
+ * Returns the calling thread's magazine, creating it on first use.
+ * Returns NULL if it could not be created; callers then fall back to
+ * the shared free list.
+ */
+static object_heap_magazine_p
+object_heap_get_magazine(object_heap_p heap)
+{
+    object_heap_magazine_p magazine = pthread_getspecific(heap->magazine_key);
+
+    if (magazine)
+        return magazine;
+
+    magazine = calloc(1, sizeof(*magazine));
+    if (NULL == magazine)
+        return NULL;
+
+    magazine->heap = heap;
+    if (pthread_setspecific(heap->magazine_key, magazine)) {
+        free(magazine);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&heap->mutex);
+    magazine->next = heap->magazines;
+    heap->magazines = magazine;
+    pthread_mutex_unlock(&heap->mutex);
+    return magazine;
+}
+
 /*
  * Return 0 on success, -1 on error
  */
 int
-object_heap_init(object_heap_p heap, int object_size, int id_offset)
+object_heap_init(object_heap_p heap, int object_size, int id_offset, int flags)
 {
     pthread_mutex_init(&heap->mutex, NULL);
+    if (pthread_key_create(&heap->magazine_key, object_heap_magazine_release)) {
+        pthread_mutex_destroy(&heap->mutex);
+        return -1;
+    }
+    heap->magazines = NULL;
+    if (flags & OBJECT_HEAP_CACHE_ALIGNED) {
+        /* No two objects share a cache line */
+        object_size = (object_size + OBJECT_HEAP_CACHE_LINE - 1) & ~(OBJECT_HEAP_CACHE_LINE - 1);
+        heap->bucket_header = OBJECT_HEAP_CACHE_LINE;
+    } else {
+        heap->bucket_header = BUCKET_HEADER;
+    }
     heap->object_size = object_size;
     heap->id_offset = id_offset & OBJECT_HEAP_OFFSET_MASK;
     heap->heap_size = 0;
-    heap->heap_increment = 16;
+    heap->heap_increment = BUCKET_MIN_OBJECTS;
     heap->next_free = LAST_FREE;
-    heap->num_buckets = 0;
-    heap->bucket = NULL;
+    heap->index = NULL;
+    heap->bucket_size = 0;
+    heap->bucket_count = 0;
+    heap->num_free = 0;
+    heap->flat_base = NULL;
+    heap->flat_committed = 0;
+    heap->flat_occupied = NULL;
+
+    if (flags & OBJECT_HEAP_FLAT) {
+        /* Address space only; pages are committed as the heap expands */
+        heap->flat_base = mmap(NULL, (size_t)OBJECT_HEAP_FLAT_MAX_OBJECTS * object_size,
+                               PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        heap->flat_occupied = calloc(OBJECT_HEAP_FLAT_MAX_OBJECTS / BITS_PER_WORD,
+                                     sizeof(unsigned long));
+        if (MAP_FAILED == heap->flat_base || NULL == heap->flat_occupied) {
+            /* Fall back to buckets */
+            if (MAP_FAILED != heap->flat_base)
+                munmap(heap->flat_base, (size_t)OBJECT_HEAP_FLAT_MAX_OBJECTS * object_size);
+            free(heap->flat_occupied);
+            heap->flat_base = NULL;
+            heap->flat_occupied = NULL;
+        }
+    }
+    if (NULL == heap->flat_base) {
+        /* Whole pages per bucket, filled up to one occupancy word */
+        size_t page_size = sysconf(_SC_PAGESIZE);
+
+        heap->bucket_size = (heap->bucket_header + (size_t)BUCKET_MIN_OBJECTS * object_size +
+                             page_size - 1) & ~(page_size - 1);
+        heap->heap_increment = (heap->bucket_size - heap->bucket_header) / object_size;
+        if (heap->heap_increment > (int)BITS_PER_WORD)
+            heap->heap_increment = BITS_PER_WORD;
+    }
     return object_heap_expand(heap);
 }
 
 /*
- * Allocates an object
+ * Takes an object off the shared free list and marks it with state,
+ * ALLOCATED or CACHED.
  * Returns the object ID on success, returns -1 on error
  */
 static int
-object_heap_allocate_unlocked(object_heap_p heap)
+object_heap_allocate_unlocked(object_heap_p heap, int state)
 {
     object_base_p obj;
-    int bucket_index, obj_index;
 
     if (LAST_FREE == heap->next_free) {
         if (-1 == object_heap_expand(heap)) {
@@ -109,60 +367,116 @@ object_heap_allocate_unlocked(object_heap_p heap)
     }
     ASSERT(heap->next_free >= 0);
 
-    bucket_index = heap->next_free / heap->heap_increment;
-    obj_index = heap->next_free % heap->heap_increment;
-
-    obj = (object_base_p)(heap->bucket[bucket_index] + obj_index * heap->object_size);
+    obj = object_heap_slot(heap, heap->next_free);
     heap->next_free = obj->next_free;
-    obj->next_free = ALLOCATED;
+    object_heap_add_free(heap, -1);
+    STORE_RELEASE(&obj->next_free, state);
+    if (ALLOCATED == state)
+        object_heap_mark(heap, obj->id & OBJECT_HEAP_ID_MASK, 1);
     return obj->id;
 }
 
 int
 object_heap_allocate(object_heap_p heap)
 {
+    object_heap_magazine_p magazine = object_heap_get_magazine(heap);
+    object_base_p obj;
     int ret;
 
+    if (magazine && 0 == magazine->count) {
+        pthread_mutex_lock(&heap->mutex);
+        while (magazine->count < OBJECT_HEAP_MAGAZINE_SIZE / 2) {
+            ret = object_heap_allocate_unlocked(heap, CACHED);
+            if (-1 == ret)
+                break;
+            magazine->slot[magazine->count++] = ret & OBJECT_HEAP_ID_MASK;
+        }
+        pthread_mutex_unlock(&heap->mutex);
+    }
+
+    if (magazine && magazine->count) {
+        obj = object_heap_slot(heap, magazine->slot[--magazine->count]);
+        ASSERT(obj->next_free == CACHED);
+        STORE_RELEASE(&obj->next_free, ALLOCATED);
+        object_heap_mark(heap, obj->id & OBJECT_HEAP_ID_MASK, 1);
+        return obj->id;
+    }
+
     pthread_mutex_lock(&heap->mutex);
-    ret = object_heap_allocate_unlocked(heap);
+    ret = object_heap_allocate_unlocked(heap, ALLOCATED);
     pthread_mutex_unlock(&heap->mutex);
     return ret;
 }
 
+static void
+object_heap_free_unlocked(object_heap_p heap, object_base_p obj);
+
+/*
+ * Allocates n objects under a single lock acquisition, all or nothing.
+ * Return 0 on success, -1 on error
+ */
+int
+object_heap_allocate_n(object_heap_p heap, int n, int *ids)
+{
+    int i;
+
+    pthread_mutex_lock(&heap->mutex);
+    for (i = 0; i < n; i++) {
+        ids[i] = object_heap_allocate_unlocked(heap, ALLOCATED);
+        if (-1 == ids[i])
+            break;
+    }
+    if (i < n) {
+        while (i--)
+            object_heap_free_unlocked(heap, object_heap_slot(heap, ids[i] & OBJECT_HEAP_ID_MASK));
+    }
+    pthread_mutex_unlock(&heap->mutex);
+    return i < n ? -1 : 0;
+}
+
 /*
  * Lookup an object by object ID
+ * Runs without the heap mutex: heap_size and the bucket index are only
+ * ever published with release semantics, and buckets stay mapped
+ * while the heap is alive. Flat heaps never move, so the lookup is a
+ * single masked index.
  * Returns a pointer to the object on success, returns NULL on error
  */
-static object_base_p
-object_heap_lookup_unlocked(object_heap_p heap, int id)
+object_base_p
+object_heap_lookup(object_heap_p heap, int id)
 {
     object_base_p obj;
-    int bucket_index, obj_index;
+    int heap_size = LOAD_ACQUIRE(&heap->heap_size);
 
-    if ((id < heap->id_offset) || (id > (heap->heap_size + heap->id_offset))) {
+    if ((id < heap->id_offset) || (id >= (heap_size + heap->id_offset))) {
         return NULL;
     }
     id &= OBJECT_HEAP_ID_MASK;
-    bucket_index = id / heap->heap_increment;
-    obj_index = id % heap->heap_increment;
-    obj = (object_base_p)(heap->bucket[bucket_index] + obj_index * heap->object_size);
+    obj = object_heap_slot(heap, id);
 
     /* Check if the object has in fact been allocated */
-    if (obj->next_free != ALLOCATED) {
+    if (LOAD_ACQUIRE(&obj->next_free) != ALLOCATED) {
         return NULL;
     }
     return obj;
 }
 
-object_base_p
-object_heap_lookup(object_heap_p heap, int id)
+/*
+ * Looks up n objects. Like object_heap_lookup this takes no lock.
+ * Return 0 if all were found, -1 if any is invalid (its entry is NULL)
+ */
+int
+object_heap_lookup_n(object_heap_p heap, const int *ids, int n, object_base_p *objs)
 {
-    object_base_p obj;
+    int ret = 0;
+    int i;
 
-    pthread_mutex_lock(&heap->mutex);
-    obj = object_heap_lookup_unlocked(heap, id);
-    pthread_mutex_unlock(&heap->mutex);
-    return obj;
+    for (i = 0; i < n; i++) {
+        objs[i] = object_heap_lookup(heap, ids[i]);
+        if (NULL == objs[i])
+            ret = -1;
+    }
+    return ret;
 }
 
 /*
@@ -184,21 +498,29 @@ static object_base_p
 object_heap_next_unlocked(object_heap_p heap, object_heap_iterator *iter)
 {
     object_base_p obj;
-    int bucket_index, obj_index;
+    int group_size = object_heap_group_size(heap);
     int i = *iter + 1;
 
     while (i < heap->heap_size) {
-        bucket_index = i / heap->heap_increment;
-        obj_index = i % heap->heap_increment;
+        unsigned long bits = LOAD_ACQUIRE(object_heap_occupancy(heap, i)) >> (i % group_size);
+
+        if (0 == bits) {
+            /* Skip the rest of this word */
+            i += group_size - i % group_size;
+            continue;
+        }
+        i += __builtin_ctzl(bits);
+        if (i >= heap->heap_size)
+            break;
 
-        obj = (object_base_p)(heap->bucket[bucket_index] + obj_index * heap->object_size);
-        if (obj->next_free == ALLOCATED) {
+        obj = object_heap_slot(heap, i);
+        if (LOAD_ACQUIRE(&obj->next_free) == ALLOCATED) {
             *iter = i;
             return obj;
         }
         i++;
     }
-    *iter = i;
+    *iter = heap->heap_size;
     return NULL;
 }
 
@@ -213,6 +535,72 @@ object_heap_next(object_heap_p heap, object_heap_iterator *iter)
     return obj;
 }
 
+/*
+ * Gives the tail of a heap back to the system once more than
+ * OBJECT_HEAP_TRIM_THRESHOLD slots sit on the shared free list. Only
+ * trailing groups (buckets of a bucket heap) whose slots are all on the
+ * shared list are released, so allocated and magazine-cached slots are
+ * never affected; half the threshold is kept as slack. The calling
+ * thread's magazine, if any, is flushed first since it usually holds the
+ * most recently freed slots. The pages stay mapped, so a racing lookup
+ * of a stale ID reads zeroes and fails cleanly.
+ * Must be called with the heap mutex held.
+ */
+static void
+object_heap_trim_unlocked(object_heap_p heap, object_heap_magazine_p magazine)
+{
+    size_t page_size, start;
+    int old_heap_size = heap->heap_size;
+    int new_heap_size = heap->heap_size;
+    int released = 0;
+    int *link;
+    int i;
+
+    if (heap->num_free <= OBJECT_HEAP_TRIM_THRESHOLD)
+        return;
+
+    if (magazine)
+        object_heap_magazine_spill(heap, magazine, OBJECT_HEAP_MAGAZINE_SIZE);
+
+    while (new_heap_size > heap->heap_increment &&
+           heap->num_free - released - heap->heap_increment >= OBJECT_HEAP_TRIM_THRESHOLD / 2) {
+        for (i = new_heap_size - heap->heap_increment; i < new_heap_size; i++) {
+            int state = LOAD_ACQUIRE(&object_heap_slot(heap, i)->next_free);
+
+            if (ALLOCATED == state || CACHED == state)
+                break;
+        }
+        if (i < new_heap_size)
+            break;
+        new_heap_size -= heap->heap_increment;
+        released += heap->heap_increment;
+    }
+    if (0 == released)
+        return;
+
+    /* Unlink the released slots from the shared free list */
+    for (link = &heap->next_free; *link != LAST_FREE;) {
+        if (*link >= new_heap_size)
+            *link = object_heap_slot(heap, *link)->next_free;
+        else
+            link = &object_heap_slot(heap, *link)->next_free;
+    }
+    object_heap_add_free(heap, -released);
+    STORE_RELEASE(&heap->heap_size, new_heap_size);
+
+    if (NULL == heap->flat_base) {
+        /* Released buckets stay in the index for the next expansion */
+        for (i = new_heap_size; i < old_heap_size; i += heap->heap_increment)
+            madvise(heap->index->bucket[i / heap->heap_increment], heap->bucket_size, MADV_DONTNEED);
+        return;
+    }
+
+    page_size = sysconf(_SC_PAGESIZE);
+    start = ((size_t)new_heap_size * heap->object_size + page_size - 1) & ~(page_size - 1);
+    if (start < heap->flat_committed)
+        madvise(heap->flat_base + start, heap->flat_committed - start, MADV_DONTNEED);
+}
+
 /*
  * Frees an object
  */
@@ -222,17 +610,66 @@ object_heap_free_unlocked(object_heap_p heap, object_base_p obj)
     /* Check if the object has in fact been allocated */
     ASSERT(obj->next_free == ALLOCATED);
 
-    obj->next_free = heap->next_free;
+    object_heap_mark(heap, obj->id & OBJECT_HEAP_ID_MASK, 0);
+    STORE_RELEASE(&obj->next_free, heap->next_free);
     heap->next_free = obj->id & OBJECT_HEAP_ID_MASK;
+    object_heap_add_free(heap, 1);
 }
 
 void
 object_heap_free(object_heap_p heap, object_base_p obj)
 {
+    object_heap_magazine_p magazine;
+
     if (!obj)
         return;
+
+    magazine = object_heap_get_magazine(heap);
+
+    /*
+     * A drained heap is trimmed when a magazine spills, or when the
+     * freed slot sits in the last group, which a trim could release but
+     * a magazine would pin. Every other free stays off the heap mutex
+     * however many slots are free.
+     */
+    if (!magazine || ((obj->id & OBJECT_HEAP_ID_MASK) >= LOAD_ACQUIRE(&heap->heap_size) - heap->heap_increment &&
+                      __atomic_load_n(&heap->num_free, __ATOMIC_RELAXED) > OBJECT_HEAP_TRIM_THRESHOLD)) {
+        pthread_mutex_lock(&heap->mutex);
+        object_heap_free_unlocked(heap, obj);
+        object_heap_trim_unlocked(heap, magazine);
+        pthread_mutex_unlock(&heap->mutex);
+        return;
+    }
+
+    if (OBJECT_HEAP_MAGAZINE_SIZE == magazine->count) {
+        pthread_mutex_lock(&heap->mutex);
+        object_heap_magazine_spill(heap, magazine, OBJECT_HEAP_MAGAZINE_SIZE / 2);
+        object_heap_trim_unlocked(heap, magazine);
+        pthread_mutex_unlock(&heap->mutex);
+    }
+
+    /* Check if the object has in fact been allocated */
+    ASSERT(obj->next_free == ALLOCATED);
+
+    object_heap_mark(heap, obj->id & OBJECT_HEAP_ID_MASK, 0);
+    STORE_RELEASE(&obj->next_free, CACHED);
+    magazine->slot[magazine->count++] = obj->id & OBJECT_HEAP_ID_MASK;
+}
+
+/*
+ * Frees n objects under a single lock acquisition. NULL entries are skipped.
+ */
+void
+object_heap_free_n(object_heap_p heap, object_base_p *objs, int n)
+{
+    int i;
+
     pthread_mutex_lock(&heap->mutex);
-    object_heap_free_unlocked(heap, obj);
+    for (i = 0; i < n; i++) {
+        if (objs[i])
+            object_heap_free_unlocked(heap, objs[i]);
+    }
+    object_heap_trim_unlocked(heap, NULL);
     pthread_mutex_unlock(&heap->mutex);
 }
 
@@ -242,26 +679,45 @@ object_heap_free(object_heap_p heap, object_base_p obj)
 void
 object_heap_destroy(object_heap_p heap)
 {
-    object_base_p obj;
-    int bucket_index, obj_index, i;
+    object_heap_index_p index, retired;
+    object_heap_magazine_p magazine, next;
+    int group_size = object_heap_group_size(heap);
+    int i;
+
+    /* Drop all magazines; the slots they hold are free already */
+    pthread_key_delete(heap->magazine_key);
+    for (magazine = heap->magazines; magazine; magazine = next) {
+        next = magazine->next;
+        free(magazine);
+    }
+    heap->magazines = NULL;
 
     /* Check if heap is empty */
-    for (i = 0; i < heap->heap_size; i++) {
-        /* Check if object is not still allocated */
-        bucket_index = i / heap->heap_increment;
-        obj_index = i % heap->heap_increment;
-        obj = (object_base_p)(heap->bucket[bucket_index] + obj_index * heap->object_size);
-        ASSERT(obj->next_free != ALLOCATED);
+    for (i = 0; i < heap->heap_size; i += group_size) {
+        ASSERT(0 == *object_heap_occupancy(heap, i));
     }
 
-    for (i = 0; i < heap->heap_size / heap->heap_increment; i++) {
-        free(heap->bucket[i]);
+    if (heap->flat_base) {
+        munmap(heap->flat_base, (size_t)OBJECT_HEAP_FLAT_MAX_OBJECTS * heap->object_size);
+        free(heap->flat_occupied);
+        heap->flat_base = NULL;
+        heap->flat_occupied = NULL;
+        heap->flat_committed = 0;
+    } else {
+        for (i = 0; i < heap->bucket_count; i++) {
+            munmap(heap->index->bucket[i], heap->bucket_size);
+        }
+        heap->bucket_count = 0;
     }
 
     pthread_mutex_destroy(&heap->mutex);
 
-    free(heap->bucket);
-    heap->bucket = NULL;
+    for (index = heap->index; index; index = retired) {
+        retired = index->retired;
+        free(index);
+    }
+    heap->index = NULL;
     heap->heap_size = 0;
+    heap->num_free = 0;
     heap->next_free = LAST_FREE;
 }
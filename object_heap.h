@@ -26,36 +26,91 @@
 #define OBJECT_HEAP_H
 
 #include <pthread.h>
+#include <stddef.h>
 
 #define OBJECT_HEAP_OFFSET_MASK 0x7F000000
 #define OBJECT_HEAP_ID_MASK     0x00FFFFFF
 
+/* object_heap_init flags */
+#define OBJECT_HEAP_FLAT        0x1     /* One reserved range, no buckets */
+#define OBJECT_HEAP_CACHE_ALIGNED 0x2   /* Slots padded to whole cache lines */
+
+#define OBJECT_HEAP_CACHE_LINE  64
+
+/* Slots reserved up front for an OBJECT_HEAP_FLAT heap, every ID the mask allows */
+#define OBJECT_HEAP_FLAT_MAX_OBJECTS    (OBJECT_HEAP_ID_MASK + 1)
+
+/* Free slots on the shared list above which a heap gives memory back */
+#define OBJECT_HEAP_TRIM_THRESHOLD      1024
+
+/* Free slots cached per thread, refilled from/spilled to the heap in halves */
+#define OBJECT_HEAP_MAGAZINE_SIZE   32
+
 typedef struct object_base *object_base_p;
 typedef struct object_heap *object_heap_p;
+typedef struct object_heap_index *object_heap_index_p;
+typedef struct object_heap_magazine *object_heap_magazine_p;
 
 struct object_base {
     int id;
     int next_free;
 };
 
+/*
+ * Bucket index of a heap. Lookups read it without taking the heap mutex,
+ * so a grown index is published as a new copy and the old one is kept on
+ * the retired chain until the heap is destroyed.
+ */
+struct object_heap_index {
+    object_heap_index_p retired;
+    int num_buckets;
+    void *bucket[];
+};
+
+/*
+ * Per-thread cache of free slot indices. Slots held here are marked as
+ * cached and belong to this thread only, so allocate/free served from a
+ * magazine do not touch the heap mutex.
+ */
+struct object_heap_magazine {
+    object_heap_p heap;
+    object_heap_magazine_p next;
+    int count;
+    int slot[OBJECT_HEAP_MAGAZINE_SIZE];
+};
+
 struct object_heap {
     pthread_mutex_t mutex;
+    pthread_key_t magazine_key;
+    object_heap_magazine_p magazines;
     int object_size;
+    int bucket_header;
     int id_offset;
     int next_free;
+    int num_free;
     int heap_size;
     int heap_increment;
-    void **bucket;
-    int num_buckets;
+    object_heap_index_p index;
+    size_t bucket_size;         /* Bytes mapped per bucket */
+    int bucket_count;           /* Buckets mapped, released ones included */
+    void *flat_base;
+    size_t flat_committed;
+    unsigned long *flat_occupied;
 };
 
 typedef int object_heap_iterator;
 
 /*
+ * flags is a mask of OBJECT_HEAP_FLAT and OBJECT_HEAP_CACHE_ALIGNED.
+ * A flat heap reserves address space for OBJECT_HEAP_FLAT_MAX_OBJECTS
+ * objects and commits it as it grows, so objects never move and lookups
+ * skip the bucket index. Either kind returns its tail to the system when
+ * it drains. A cache aligned heap starts every object on its own
+ * cache line, so threads working on neighbouring objects don't false share.
  * Return 0 on success, -1 on error
  */
 int
-object_heap_init(object_heap_p heap, int object_size, int id_offset);
+object_heap_init(object_heap_p heap, int object_size, int id_offset, int flags);
 
 /*
  * Allocates an object
@@ -64,13 +119,28 @@ object_heap_init(object_heap_p heap, int object_size, int id_offset);
 int
 object_heap_allocate(object_heap_p heap);
 
+/*
+ * Allocates n objects under a single lock acquisition, all or nothing
+ * Return 0 on success, -1 on error
+ */
+int
+object_heap_allocate_n(object_heap_p heap, int n, int *ids);
+
 /*
  * Lookup an allocated object by object ID
+ * Never blocks: the heap mutex is only taken by allocate/free/iterate.
  * Returns a pointer to the object on success, returns NULL on error
  */
 object_base_p
 object_heap_lookup(object_heap_p heap, int id);
 
+/*
+ * Lookup n objects by object ID
+ * Returns 0 if all were found, -1 if any was not (its entry is set to NULL)
+ */
+int
+object_heap_lookup_n(object_heap_p heap, const int *ids, int n, object_base_p *objs);
+
 /*
  * Iterate over all objects in the heap.
  * Returns a pointer to the first object on the heap, returns NULL if heap is empty.
@@ -91,6 +161,12 @@ object_heap_next(object_heap_p heap, object_heap_iterator *iter);
 void
 object_heap_free(object_heap_p heap, object_base_p obj);
 
+/*
+ * Frees n objects under a single lock acquisition, NULL entries are skipped
+ */
+void
+object_heap_free_n(object_heap_p heap, object_base_p *objs, int n);
+
 /*
  * Destroys a heap, the heap must be empty.
  */
@@ -26,15 +26,29 @@
 #include <va/va_backend.h>
 
 #include "rockchip_drv_video.h"
+#include "image_convert.h"
+#include "cpu_features.h"
 
 #include "assert.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <unistd.h>
+#include <time.h>
 
 #define ASSERT	assert
 
+#define MIN(a, b)	((a) < (b) ? (a) : (b))
+#define ALIGN(x, a)	(((x) + (a) - 1) & ~((a) - 1))
+
+#ifndef VA_RT_FORMAT_YUV420_10
+#define VA_RT_FORMAT_YUV420_10	VA_RT_FORMAT_YUV420_10BPP
+#endif
+#ifndef VA_FOURCC_P010
+#define VA_FOURCC_P010		VA_FOURCC('P', '0', '1', '0')
+#endif
+
 #define INIT_DRIVER_DATA	struct rockchip_driver_data * const driver_data = (struct rockchip_driver_data *) ctx->pDriverData;
 
 #define CONFIG(id)  ((object_config_p) object_heap_lookup( &driver_data->config_heap, id ))
@@ -51,8 +65,12 @@
 
 #define NEW_IMAGE_ID() object_heap_allocate(&driver_data->image_heap);
 
+/* Objects looked up per batched heap call without going to malloc */
+#define ROCKCHIP_BATCH_SIZE		64
+
 enum {
     ROCKCHIP_SURFACETYPE_YUV,
+    ROCKCHIP_SURFACETYPE_RGBA,
     ROCKCHIP_SURFACETYPE_INDEXED,
 };
 
@@ -64,8 +82,22 @@ typedef struct {
 
 static const rockchip_image_format_map_t
 rockchip_image_formats_map[] = {
+	{ ROCKCHIP_SURFACETYPE_YUV,
+	 { VA_FOURCC_NV12, VA_LSB_FIRST, 12, } },
 	{ ROCKCHIP_SURFACETYPE_YUV,
 	 { VA_FOURCC_YV12, VA_LSB_FIRST, 12, } },
+	{ ROCKCHIP_SURFACETYPE_YUV,
+	 { VA_FOURCC_I420, VA_LSB_FIRST, 12, } },
+	{ ROCKCHIP_SURFACETYPE_YUV,
+	 { VA_FOURCC_YUY2, VA_LSB_FIRST, 16, } },
+	{ ROCKCHIP_SURFACETYPE_YUV,
+	 { VA_FOURCC_UYVY, VA_LSB_FIRST, 16, } },
+	{ ROCKCHIP_SURFACETYPE_RGBA,
+	 { VA_FOURCC_RGBX, VA_LSB_FIRST, 32, 24, 0x000000ff, 0x0000ff00, 0x00ff0000 } },
+	{ ROCKCHIP_SURFACETYPE_RGBA,
+	 { VA_FOURCC_BGRX, VA_LSB_FIRST, 32, 24, 0x00ff0000, 0x0000ff00, 0x000000ff } },
+	{ ROCKCHIP_SURFACETYPE_YUV,
+	 { VA_FOURCC_P010, VA_LSB_FIRST, 24, } },
 	{},
 
 };
@@ -177,10 +209,18 @@ VAStatus rockchip_GetConfigAttributes(
     /* What to do if we don't know the attribute? */
     for (i = 0; i < num_attribs; i++)
     {
-        switch (attrib_list[i].type)
+        switch ((int) attrib_list[i].type)
         {
           case VAConfigAttribRTFormat:
-              attrib_list[i].value = VA_RT_FORMAT_YUV420;
+              attrib_list[i].value = VA_RT_FORMAT_YUV420 | VA_RT_FORMAT_YUV420_10;
+              break;
+
+          case ROCKCHIP_CONFIG_ATTRIB_DECODE_DEPTH:
+              attrib_list[i].value = DECODE_WORKER_MAX_DEPTH;
+              break;
+
+          case ROCKCHIP_CONFIG_ATTRIB_LOW_LATENCY:
+              attrib_list[i].value = 1;
               break;
 
           default:
@@ -197,7 +237,7 @@ static VAStatus rockchip__update_attribute(object_config_p obj_config, VAConfigA
 {
     int i;
     /* Check existing attrbiutes */
-    for(i = 0; obj_config->attrib_count < i; i++)
+    for(i = 0; i < obj_config->attrib_count; i++)
     {
         if (obj_config->attrib_list[i].type == attrib->type)
         {
@@ -312,6 +352,13 @@ VAStatus rockchip_CreateConfig(
 
     for(i = 0; i < num_attribs; i++)
     {
+        if ((ROCKCHIP_CONFIG_ATTRIB_DECODE_DEPTH == attrib_list[i].type &&
+             (attrib_list[i].value < 1 || attrib_list[i].value > DECODE_WORKER_MAX_DEPTH)) ||
+            (ROCKCHIP_CONFIG_ATTRIB_LOW_LATENCY == attrib_list[i].type && attrib_list[i].value > 1))
+        {
+            vaStatus = VA_STATUS_ERROR_INVALID_VALUE;
+            break;
+        }
         vaStatus = rockchip__update_attribute(obj_config, &(attrib_list[i]));
         if (VA_STATUS_SUCCESS != vaStatus)
         {
@@ -380,6 +427,215 @@ VAStatus rockchip_QueryConfigAttributes(
     return vaStatus;
 }
 
+/*
+ * Bytes taken by n samples of a surface row. NV15 rows are addressed
+ * in groups of four samples.
+ */
+static inline unsigned int rockchip__surface_row_bytes(const struct object_surface *obj_surface, unsigned int n)
+{
+    return ROCKCHIP_FOURCC_NV15 == obj_surface->fourcc ? ALIGN(n, 4) * 5 / 4 : n;
+}
+
+/*
+ * NV12, or NV15 for 10 bit, with pitches and heights padded for the
+ * hardware and SIMD code. Returns the frame size in bytes
+ */
+static unsigned int rockchip__init_surface_layout(object_surface_p obj_surface, int width, int height, int format)
+{
+    unsigned int pitch;
+    unsigned int aligned_height = ALIGN(height, ROCKCHIP_SURFACE_HEIGHT_ALIGN);
+
+    obj_surface->orig_width = width;
+    obj_surface->orig_height = height;
+    obj_surface->format = format;
+    obj_surface->fourcc = VA_RT_FORMAT_YUV420_10 == format ? ROCKCHIP_FOURCC_NV15 : VA_FOURCC_NV12;
+    pitch = ALIGN(rockchip__surface_row_bytes(obj_surface, width), ROCKCHIP_SURFACE_PITCH_ALIGN);
+    obj_surface->num_planes = 2;
+    obj_surface->pitches[0] = pitch;
+    obj_surface->offsets[0] = 0;
+    obj_surface->pitches[1] = pitch;
+    obj_surface->offsets[1] = pitch * aligned_height;
+    obj_surface->pitches[2] = 0;
+    obj_surface->offsets[2] = 0;
+    obj_surface->size = pitch * aligned_height * 3 / 2;
+    obj_surface->data = NULL;
+    obj_surface->layout = ROCKCHIP_SURFACE_LAYOUT_LINEAR;
+    return obj_surface->size;
+}
+
+/*
+ * Bytes and lines of the luma blocks of a tiled surface. Chroma blocks
+ * have half the lines.
+ */
+static inline void rockchip__layout_tile_size(int layout, unsigned int *tile_width, unsigned int *tile_height)
+{
+    *tile_width = *tile_height = ROCKCHIP_SURFACE_LAYOUT_TILE4X4 == layout ? 4 : 16;
+}
+
+static inline void rockchip__surface_tile_size(const struct object_surface *obj_surface,
+                                               unsigned int *tile_width, unsigned int *tile_height)
+{
+    rockchip__layout_tile_size(obj_surface->layout, tile_width, tile_height);
+}
+
+/*
+ * A layout change of the luma rows [first_row, first_row + rows) of a
+ * tiled surface, and the chroma rows under them, to or from a linear
+ * frame of the same geometry. Run by the copy engine in bands of luma
+ * rows.
+ */
+struct layout_job {
+    const struct object_surface *obj_surface;
+    uint8_t *data;
+    unsigned int tile_width;
+    unsigned int tile_height;
+    unsigned int first_row;
+};
+
+static void rockchip__detile_rows(void *arg, unsigned int first_row, unsigned int num_rows)
+{
+    const struct layout_job * const job = arg;
+    const struct object_surface * const obj_surface = job->obj_surface;
+
+    first_row += job->first_row;
+    image_convert_detile_plane(job->data + obj_surface->offsets[0] + first_row * obj_surface->pitches[0],
+                               obj_surface->pitches[0],
+                               obj_surface->data + obj_surface->offsets[0], obj_surface->pitches[0],
+                               job->tile_width, job->tile_height,
+                               0, first_row, obj_surface->pitches[0], num_rows);
+    image_convert_detile_plane(job->data + obj_surface->offsets[1] + first_row / 2 * obj_surface->pitches[1],
+                               obj_surface->pitches[1],
+                               obj_surface->data + obj_surface->offsets[1], obj_surface->pitches[1],
+                               job->tile_width, job->tile_height / 2,
+                               0, first_row / 2, obj_surface->pitches[1], num_rows / 2);
+}
+
+static void rockchip__tile_rows(void *arg, unsigned int first_row, unsigned int num_rows)
+{
+    const struct layout_job * const job = arg;
+    const struct object_surface * const obj_surface = job->obj_surface;
+
+    first_row += job->first_row;
+    image_convert_tile_plane(obj_surface->data + obj_surface->offsets[0], obj_surface->pitches[0],
+                             job->data + obj_surface->offsets[0] + first_row * obj_surface->pitches[0],
+                             obj_surface->pitches[0], job->tile_width, job->tile_height,
+                             first_row, obj_surface->pitches[0], num_rows);
+    image_convert_tile_plane(obj_surface->data + obj_surface->offsets[1], obj_surface->pitches[1],
+                             job->data + obj_surface->offsets[1] + first_row / 2 * obj_surface->pitches[1],
+                             obj_surface->pitches[1], job->tile_width, job->tile_height / 2,
+                             first_row / 2, obj_surface->pitches[1], num_rows / 2);
+}
+
+/*
+ * Linear working copies of tiled surfaces, for the scaled and wide
+ * accesses that can't detile through a bounce buffer. The copy is a
+ * frame from the surface cache with the surface's geometry; the surface
+ * itself stays tiled. first_row and num_rows are even.
+ */
+static VAStatus rockchip__begin_linear_access(struct rockchip_driver_data *driver_data,
+                                              const struct object_surface *obj_surface,
+                                              object_surface_p linear,
+                                              unsigned int first_row, unsigned int num_rows)
+{
+    struct layout_job job;
+    void *frame;
+
+    if (-1 == surface_cache_alloc_n( &driver_data->surface_cache, obj_surface->orig_width,
+                                     obj_surface->orig_height, obj_surface->format,
+                                     obj_surface->size, 1, &frame ))
+    {
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    }
+
+    *linear = *obj_surface;
+    linear->data = frame;
+    linear->layout = ROCKCHIP_SURFACE_LAYOUT_LINEAR;
+
+    job.obj_surface = obj_surface;
+    job.data = frame;
+    job.first_row = first_row;
+    rockchip__surface_tile_size(obj_surface, &job.tile_width, &job.tile_height);
+    copy_engine_run( &driver_data->copy_engine, rockchip__detile_rows, &job,
+                     num_rows, obj_surface->pitches[0] * 3 / 2 );
+    return VA_STATUS_SUCCESS;
+}
+
+/*
+ * Drops the copy, after tiling its rows [first_row, first_row + num_rows)
+ * back into the surface if they were written
+ */
+static void rockchip__end_linear_access(struct rockchip_driver_data *driver_data,
+                                        object_surface_p obj_surface, object_surface_p linear,
+                                        unsigned int first_row, unsigned int num_rows)
+{
+    struct layout_job job;
+
+    if (num_rows)
+    {
+        job.obj_surface = obj_surface;
+        job.data = linear->data;
+        job.first_row = first_row;
+        rockchip__surface_tile_size(obj_surface, &job.tile_width, &job.tile_height);
+        copy_engine_run( &driver_data->copy_engine, rockchip__tile_rows, &job,
+                         num_rows, obj_surface->pitches[0] * 3 / 2 );
+    }
+
+    surface_cache_free_n( &driver_data->surface_cache, obj_surface->orig_width,
+                          obj_surface->orig_height, obj_surface->format,
+                          obj_surface->size, 1, (void **) &linear->data );
+}
+
+/*
+ * Waits until the pictures queued for a surface are decoded. Pictures of
+ * other surfaces still in flight are not waited for. A low latency
+ * picture can't finish before its vaEndPicture, so a surface with one
+ * still open is reported busy rather than waited for.
+ */
+static VAStatus rockchip__sync_surface(struct rockchip_driver_data *driver_data, object_surface_p obj_surface)
+{
+    VAStatus vaStatus = VA_STATUS_SUCCESS;
+
+    pthread_mutex_lock(&driver_data->decode_mutex);
+    if (obj_surface->streaming)
+    {
+        vaStatus = VA_STATUS_ERROR_SURFACE_BUSY;
+    }
+    while (!obj_surface->streaming && obj_surface->pending)
+    {
+        pthread_cond_wait(&driver_data->decode_cond, &driver_data->decode_mutex);
+    }
+    pthread_mutex_unlock(&driver_data->decode_mutex);
+    return vaStatus;
+}
+
+/*
+ * Releases the pixel memory of n surfaces to the surface cache, in one
+ * round trip per run of alike surfaces, and frees them.
+ */
+static void rockchip__destroy_surfaces(struct rockchip_driver_data *driver_data, object_surface_p *obj_surfaces, int num_surfaces)
+{
+    void *batch[ROCKCHIP_BATCH_SIZE];
+    int i, n = 0;
+
+    for (i = 0; i < num_surfaces; i++)
+    {
+        rockchip__sync_surface(driver_data, obj_surfaces[i]);
+        batch[n++] = obj_surfaces[i]->data;
+        obj_surfaces[i]->data = NULL;
+        if (i + 1 == num_surfaces || n == ROCKCHIP_BATCH_SIZE ||
+            obj_surfaces[i + 1]->orig_width != obj_surfaces[i]->orig_width ||
+            obj_surfaces[i + 1]->orig_height != obj_surfaces[i]->orig_height ||
+            obj_surfaces[i + 1]->format != obj_surfaces[i]->format)
+        {
+            surface_cache_free_n( &driver_data->surface_cache, obj_surfaces[i]->orig_width,
+                                  obj_surfaces[i]->orig_height, obj_surfaces[i]->format,
+                                  obj_surfaces[i]->size, n, batch );
+            n = 0;
+        }
+    }
+    object_heap_free_n( &driver_data->surface_heap, (object_base_p *) obj_surfaces, num_surfaces );
+}
+
 VAStatus rockchip_CreateSurfaces(
 		VADriverContextP ctx,
 		int width,
@@ -391,40 +647,76 @@ VAStatus rockchip_CreateSurfaces(
 {
     INIT_DRIVER_DATA
     VAStatus vaStatus = VA_STATUS_SUCCESS;
+    struct object_surface layout;
+    void *batch[ROCKCHIP_BATCH_SIZE];
+    void **frames = batch;
     int i;
 
-    /* We only support one format */
-    if (VA_RT_FORMAT_YUV420 != format)
+    if (VA_RT_FORMAT_YUV420 != format && VA_RT_FORMAT_YUV420_10 != format)
     {
         return VA_STATUS_ERROR_UNSUPPORTED_RT_FORMAT;
     }
 
-    for (i = 0; i < num_surfaces; i++)
+    if (width <= 0 || height <= 0)
     {
-        int surfaceID = object_heap_allocate( &driver_data->surface_heap );
-        object_surface_p obj_surface = SURFACE(surfaceID);
-        if (NULL == obj_surface)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+    }
+
+    if (num_surfaces > ROCKCHIP_BATCH_SIZE)
+    {
+        frames = malloc(num_surfaces * sizeof(void *));
+        if (NULL == frames)
         {
-            vaStatus = VA_STATUS_ERROR_ALLOCATION_FAILED;
-            break;
+            return VA_STATUS_ERROR_ALLOCATION_FAILED;
         }
-        obj_surface->surface_id = surfaceID;
-        surfaces[i] = surfaceID;
     }
 
-    /* Error recovery */
-    if (VA_STATUS_SUCCESS != vaStatus)
+    for (i = 0; i < num_surfaces; i++)
+    {
+        surfaces[i] = VA_INVALID_SURFACE;
+    }
+
+    /* The whole set in one heap and one cache lock round trip */
+    rockchip__init_surface_layout(&layout, width, height, format);
+    if (-1 == object_heap_allocate_n( &driver_data->surface_heap, num_surfaces, (int *) surfaces ))
     {
-        /* surfaces[i-1] was the last successful allocation */
-        for(; i--; )
+        vaStatus = VA_STATUS_ERROR_ALLOCATION_FAILED;
+    }
+    else if (-1 == surface_cache_alloc_n( &driver_data->surface_cache, width, height, format,
+                                          layout.size, num_surfaces, frames ))
+    {
+        for (i = 0; i < num_surfaces; i++)
         {
-            object_surface_p obj_surface = SURFACE(surfaces[i]);
+            object_heap_free( &driver_data->surface_heap, (object_base_p) SURFACE(surfaces[i]) );
             surfaces[i] = VA_INVALID_SURFACE;
+        }
+        vaStatus = VA_STATUS_ERROR_ALLOCATION_FAILED;
+    }
+    else
+    {
+        for (i = 0; i < num_surfaces; i++)
+        {
+            object_surface_p obj_surface = SURFACE(surfaces[i]);
             ASSERT(obj_surface);
-            object_heap_free( &driver_data->surface_heap, (object_base_p) obj_surface);
+            obj_surface->surface_id = surfaces[i];
+            rockchip__init_surface_layout(obj_surface, width, height, format);
+            /* 8 bit frames are kept in the decoder's layout from the start */
+            if (VA_FOURCC_NV12 == obj_surface->fourcc)
+            {
+                obj_surface->layout = driver_data->surface_layout;
+            }
+            obj_surface->data = frames[i];
+            obj_surface->caching = driver_data->frame_arena.caching;
+            obj_surface->derived_image = VA_INVALID_ID;
+            obj_surface->pending = 0;
+            obj_surface->streaming = 0;
         }
     }
 
+    if (frames != batch)
+    {
+        free(frames);
+    }
     return vaStatus;
 }
 
@@ -435,14 +727,50 @@ VAStatus rockchip_DestroySurfaces(
 	)
 {
     INIT_DRIVER_DATA
-    int i;
-    for(i = num_surfaces; i--; )
+    VAStatus vaStatus = VA_STATUS_SUCCESS;
+    object_base_p batch[ROCKCHIP_BATCH_SIZE];
+    object_base_p *obj_surfaces = batch;
+
+    if (num_surfaces > ROCKCHIP_BATCH_SIZE)
     {
-        object_surface_p obj_surface = SURFACE(surface_list[i]);
-        ASSERT(obj_surface);
-        object_heap_free( &driver_data->surface_heap, (object_base_p) obj_surface);
+        obj_surfaces = malloc(num_surfaces * sizeof(object_base_p));
+        if (NULL == obj_surfaces)
+        {
+            return VA_STATUS_ERROR_ALLOCATION_FAILED;
+        }
     }
-    return VA_STATUS_SUCCESS;
+
+    if (-1 == object_heap_lookup_n( &driver_data->surface_heap, (int *) surface_list, num_surfaces, obj_surfaces ))
+    {
+        vaStatus = VA_STATUS_ERROR_INVALID_SURFACE;
+    }
+    else
+    {
+        int i;
+
+        /* A derived image still aliases the frame, an open low latency picture still decodes into it */
+        for (i = 0; i < num_surfaces && VA_STATUS_SUCCESS == vaStatus; i++)
+        {
+            if (((object_surface_p) obj_surfaces[i])->derived_image != VA_INVALID_ID)
+            {
+                vaStatus = VA_STATUS_ERROR_SURFACE_BUSY;
+            }
+            else
+            {
+                vaStatus = rockchip__sync_surface(driver_data, (object_surface_p) obj_surfaces[i]);
+            }
+        }
+        if (VA_STATUS_SUCCESS == vaStatus)
+        {
+            rockchip__destroy_surfaces(driver_data, (object_surface_p *) obj_surfaces, num_surfaces);
+        }
+    }
+
+    if (obj_surfaces != batch)
+    {
+        free(obj_surfaces);
+    }
+    return vaStatus;
 }
 
 VAStatus rockchip_QueryImageFormats(
@@ -491,26 +819,61 @@ VAStatus rockchip_CreateImage(
 	if (!obj_image)
 		return VA_STATUS_ERROR_ALLOCATION_FAILED;
 	obj_image->palette    = NULL;
+	obj_image->derived_surface = VA_INVALID_ID;
 
 	VAImage * const image = &obj_image->image;
 	image->image_id       = image_id;
 	image->buf            = VA_INVALID_ID;
 
+	/* Chroma of odd sizes rounds up, as the conversion kernels do */
 	size = width * height;
-	size2 = (width / 2) * (height / 2);
+	size2 = ((width + 1) / 2) * ((height + 1) / 2);
 
 	switch (format->fourcc) {
 	case VA_FOURCC_YV12:
+	case VA_FOURCC_I420:
 		image->num_planes = 3;
 		image->pitches[0] = width;
 		image->offsets[0] = 0;
-		image->pitches[1] = width / 2;
+		image->pitches[1] = (width + 1) / 2;
 		image->offsets[1] = size;
-		image->pitches[2] = width / 2;
+		image->pitches[2] = (width + 1) / 2;
 		image->offsets[2] = size + size2;
 		image->data_size  = size + 2 * size2;
 		break;
+	case VA_FOURCC_NV12:
+		image->num_planes = 2;
+		image->pitches[0] = width;
+		image->offsets[0] = 0;
+		image->pitches[1] = ALIGN(width, 2);
+		image->offsets[1] = size;
+		image->data_size  = size + 2 * size2;
+		break;
+	case VA_FOURCC_YUY2:
+	case VA_FOURCC_UYVY:
+		image->num_planes = 1;
+		image->pitches[0] = ALIGN(width, 2) * 2;
+		image->offsets[0] = 0;
+		image->data_size  = image->pitches[0] * height;
+		break;
+	case VA_FOURCC_RGBX:
+	case VA_FOURCC_BGRX:
+		image->num_planes = 1;
+		image->pitches[0] = width * 4;
+		image->offsets[0] = 0;
+		image->data_size  = image->pitches[0] * height;
+		break;
+	case VA_FOURCC_P010:
+		/* Rows hold whole NV15 groups of four samples */
+		image->num_planes = 2;
+		image->pitches[0] = ALIGN(width, 4) * 2;
+		image->offsets[0] = 0;
+		image->pitches[1] = ALIGN(width, 4) * 2;
+		image->offsets[1] = image->pitches[0] * height;
+		image->data_size  = image->pitches[0] * (height + (height + 1) / 2);
+		break;
 	default:
+		va_status = VA_STATUS_ERROR_INVALID_IMAGE_FORMAT;
 		goto error;
 
 	}
@@ -537,16 +900,112 @@ error:
 	return va_status;
 }
 
+static void rockchip__destroy_buffer(struct rockchip_driver_data *driver_data, object_buffer_p obj_buffer);
+
+/*
+ * The image and its buffer alias the surface frame, no copy is made.
+ * The surface can't be destroyed until the image is. Tiled frames have
+ * no image format, applications read them with vaGetImage instead.
+ */
 VAStatus rockchip_DeriveImage(
 	VADriverContextP ctx,
 	VASurfaceID surface,
-	VAImage *image     /* out */
+	VAImage *out_image     /* out */
 )
 {
-    /* TODO */
+    INIT_DRIVER_DATA
+	struct object_surface *obj_surface = SURFACE(surface);
+	struct object_image *obj_image;
+	struct object_buffer *obj_buffer;
+	VAImageID image_id;
+	VABufferID buf_id;
+	VAStatus va_status;
+	unsigned int i;
+
+	out_image->image_id = VA_INVALID_ID;
+	out_image->buf      = VA_INVALID_ID;
+
+	if (!obj_surface)
+		return VA_STATUS_ERROR_INVALID_SURFACE;
+	if (obj_surface->derived_image != VA_INVALID_ID)
+		return VA_STATUS_ERROR_SURFACE_BUSY;
+
+	va_status = rockchip__sync_surface(driver_data, obj_surface);
+	if (va_status != VA_STATUS_SUCCESS)
+		return va_status;
+	if (ROCKCHIP_SURFACE_LAYOUT_LINEAR != obj_surface->layout)
+		return VA_STATUS_ERROR_OPERATION_FAILED;
+
+	image_id = NEW_IMAGE_ID();
+	obj_image = IMAGE(image_id);
+	if (!obj_image)
+		return VA_STATUS_ERROR_ALLOCATION_FAILED;
+
+	buf_id = object_heap_allocate(&driver_data->buffer_heap);
+	obj_buffer = BUFFER(buf_id);
+	if (!obj_buffer) {
+		object_heap_free(&driver_data->image_heap, (struct object_base *)obj_image);
+		return VA_STATUS_ERROR_ALLOCATION_FAILED;
+	}
+
+	obj_buffer->buffer_data      = obj_surface->data;
+	obj_buffer->num_elements     = 1;
+	obj_buffer->type             = VAImageBufferType;
+	obj_buffer->size             = obj_surface->size;
+	obj_buffer->max_num_elements = 1;
+	obj_buffer->mem_type         = ROCKCHIP_BUFFER_MEM_SURFACE;
+	obj_buffer->export_count     = 0;
+	obj_buffer->exported         = 0;
+
+	obj_image->palette         = NULL;
+	obj_image->derived_surface = surface;
+
+	VAImage * const image = &obj_image->image;
+	memset(image, 0, sizeof(*image));
+	image->image_id          = image_id;
+	image->buf               = buf_id;
+	image->format.fourcc     = obj_surface->fourcc;
+	image->format.byte_order = VA_LSB_FIRST;
+	image->format.bits_per_pixel = ROCKCHIP_FOURCC_NV15 == obj_surface->fourcc ? 15 : 12;
+	image->width             = obj_surface->orig_width;
+	image->height            = obj_surface->orig_height;
+	image->data_size         = obj_surface->size;
+	image->num_planes        = obj_surface->num_planes;
+	for (i = 0; i < obj_surface->num_planes; i++) {
+		image->pitches[i] = obj_surface->pitches[i];
+		image->offsets[i] = obj_surface->offsets[i];
+	}
+
+	obj_surface->derived_image = image_id;
+
+	*out_image = *image;
     return VA_STATUS_SUCCESS;
 }
 
+static void rockchip__destroy_image(struct rockchip_driver_data *driver_data, object_image_p obj_image)
+{
+	struct object_buffer *obj_buffer = BUFFER(obj_image->image.buf);
+	struct object_surface *obj_surface;
+
+	if (obj_buffer)
+		rockchip__destroy_buffer(driver_data, obj_buffer);
+	obj_image->image.buf = VA_INVALID_ID;
+
+	if (obj_image->derived_surface != VA_INVALID_ID) {
+		obj_surface = SURFACE(obj_image->derived_surface);
+		if (obj_surface)
+			obj_surface->derived_image = VA_INVALID_ID;
+		obj_image->derived_surface = VA_INVALID_ID;
+	}
+
+	if (obj_image->palette) {
+			free(obj_image->palette);
+			obj_image->palette = NULL;
+	}
+
+	object_heap_free(&driver_data->image_heap, (struct object_base *)obj_image);
+}
+
 VAStatus rockchip_DestroyImage(
 	VADriverContextP ctx,
 	VAImageID image
@@ -557,17 +1016,8 @@ VAStatus rockchip_DestroyImage(
 
 	if (!obj_image)
 		return VA_STATUS_SUCCESS;
-	if (obj_image->image.buf != VA_INVALID_ID) {
-			rockchip_DestroyBuffer(ctx, obj_image->image.buf);
-			obj_image->image.buf = VA_INVALID_ID;
-	}
 
-	if (obj_image->palette) {
-			free(obj_image->palette);
-			obj_image->palette = NULL;
-	}
-	
-	object_heap_free(&driver_data->image_heap, (struct object_base *)obj_image);
+	rockchip__destroy_image(driver_data, obj_image);
 
     return VA_STATUS_SUCCESS;
 }
@@ -582,48 +1032,223 @@ VAStatus rockchip_SetImagePalette(
     return VA_STATUS_SUCCESS;
 }
 
-#define SQUARE_SIZE 5
-#define MIN(X,Y) ((X) < (Y) ? (X) : (Y))
-static VAStatus
-get_image_i420(struct object_image *obj_image, uint8_t *image_data,
-               struct object_surface *obj_surface,
-               const VARectangle *rect)
-{
-	uint8_t *dst[3];
-	/* Always YVU 4:2:0 */
-	const int Y = 0;
-	const int V = 1;
-	const int U = 2;
-	int x, y;
-	double rx, ry;
-	static int t = 0;
-
-	VAStatus va_status = VA_STATUS_SUCCESS;
+/*
+ * A readback of rect of the surface frame into an image, width x height
+ * output pixels, run by the copy engine in bands of output rows
+ */
+struct get_image_job {
+	const VAImage *image;
+	uint8_t *image_data;
+	const struct object_surface *obj_surface;
+	VARectangle rect;
+	unsigned int width;
+	unsigned int height;
+};
 
-	/* Dest VA image has either I420 or YV12 format. */
-	dst[Y] = image_data + obj_image->image.offsets[Y];
-	dst[U] = image_data + obj_image->image.offsets[U];
-	dst[V] = image_data + obj_image->image.offsets[V];
+/*
+ * Converts rows [first_row, first_row + num_rows) of the output from the
+ * given source planes, which start at that row
+ */
+static void
+get_image_convert(const struct get_image_job *job,
+                         unsigned int first_row, unsigned int num_rows,
+                         const uint8_t *src_y, unsigned int src_y_pitch,
+                         const uint8_t *src_uv, unsigned int src_uv_pitch)
+{
+	const VAImage * const image = job->image;
+	const unsigned int uv_row = first_row / 2;
+	uint8_t *dst_y, *dst_u, *dst_v;
+
+	dst_y = job->image_data + image->offsets[0] + first_row * image->pitches[0];
+
+	/* 10 bit surfaces only go to P010 */
+	if (ROCKCHIP_FOURCC_NV15 == job->obj_surface->fourcc) {
+		image_convert_nv15_to_p010(dst_y, image->pitches[0],
+		                           job->image_data + image->offsets[1] + uv_row * image->pitches[1],
+		                           image->pitches[1],
+		                           src_y, src_y_pitch, src_uv, src_uv_pitch,
+		                           ALIGN(job->width, 4), num_rows);
+		return;
+	}
 
-	memset(dst[Y], 0, rect->width * rect->height);
-	memset(dst[U], 128, (rect->width / 2) * (rect->height / 2));
-	memset(dst[V], 128, (rect->width / 2) * (rect->height / 2));
+	switch (image->format.fourcc) {
+	case VA_FOURCC_YUY2:
+		image_convert_nv12_to_yuy2(dst_y, image->pitches[0], src_y, src_y_pitch,
+		                           src_uv, src_uv_pitch, job->width, num_rows);
+		break;
+	case VA_FOURCC_UYVY:
+		image_convert_nv12_to_uyvy(dst_y, image->pitches[0], src_y, src_y_pitch,
+		                           src_uv, src_uv_pitch, job->width, num_rows);
+		break;
+	case VA_FOURCC_RGBX:
+		image_convert_nv12_to_rgbx(dst_y, image->pitches[0], src_y, src_y_pitch,
+		                           src_uv, src_uv_pitch, job->width, num_rows);
+		break;
+	case VA_FOURCC_BGRX:
+		image_convert_nv12_to_bgrx(dst_y, image->pitches[0], src_y, src_y_pitch,
+		                           src_uv, src_uv_pitch, job->width, num_rows);
+		break;
+	case VA_FOURCC_P010:
+		image_convert_nv12_to_p010(dst_y, image->pitches[0],
+		                           job->image_data + image->offsets[1] + uv_row * image->pitches[1],
+		                           image->pitches[1],
+		                           src_y, src_y_pitch, src_uv, src_uv_pitch,
+		                           job->width, num_rows);
+		break;
+	case VA_FOURCC_NV12:
+		image_convert_copy_plane(dst_y, image->pitches[0],
+		                         src_y, src_y_pitch,
+		                         job->width, num_rows);
+		image_convert_copy_plane(job->image_data + image->offsets[1] + uv_row * image->pitches[1],
+		                         image->pitches[1],
+		                         src_uv, src_uv_pitch,
+		                         (job->width + 1) & ~1, (num_rows + 1) / 2);
+		break;
+	case VA_FOURCC_I420:
+		dst_u = job->image_data + image->offsets[1] + uv_row * image->pitches[1];
+		dst_v = job->image_data + image->offsets[2] + uv_row * image->pitches[2];
+		image_convert_nv12_to_yuv420(dst_y, image->pitches[0],
+		                             dst_u, image->pitches[1], dst_v, image->pitches[2],
+		                             src_y, src_y_pitch, src_uv, src_uv_pitch,
+		                             job->width, num_rows);
+		break;
+	case VA_FOURCC_YV12:
+		dst_v = job->image_data + image->offsets[1] + uv_row * image->pitches[1];
+		dst_u = job->image_data + image->offsets[2] + uv_row * image->pitches[2];
+		image_convert_nv12_to_yuv420(dst_y, image->pitches[0],
+		                             dst_u, image->pitches[2], dst_v, image->pitches[1],
+		                             src_y, src_y_pitch, src_uv, src_uv_pitch,
+		                             job->width, num_rows);
+		break;
+	}
+}
 
-	rx = cos(7 * t / 3.14 / 25 * 100 / rect->width);
-	ry = sin(6 * t / 3.14 / 25 * 100 / rect->width);
+static void
+get_image_rows(void *arg, unsigned int first_row, unsigned int num_rows)
+{
+	const struct get_image_job * const job = arg;
+	const struct object_surface * const obj_surface = job->obj_surface;
+	const unsigned int y_bytes = rockchip__surface_row_bytes(obj_surface, job->width);
+	const unsigned int uv_bytes = rockchip__surface_row_bytes(obj_surface, (job->width + 1) & ~1);
+	const unsigned int stage_pitch = ALIGN(uv_bytes, 64);
+	unsigned int chunk = (IMAGE_CONVERT_BOUNCE_SIZE / (stage_pitch * 3 / 2)) & ~1;
+	uint8_t bounce[IMAGE_CONVERT_BOUNCE_SIZE] __attribute__((aligned(64)));
+	const uint8_t *src_y, *src_uv;
+	unsigned int tile_width, tile_height, align = 1;
+	unsigned int row, n;
+
+	src_y  = obj_surface->data + obj_surface->offsets[0] +
+	         (job->rect.y + first_row) * obj_surface->pitches[0] +
+	         rockchip__surface_row_bytes(obj_surface, job->rect.x);
+	src_uv = obj_surface->data + obj_surface->offsets[1] +
+	         (job->rect.y / 2 + first_row / 2) * obj_surface->pitches[1] +
+	         rockchip__surface_row_bytes(obj_surface, job->rect.x & ~1);
+
+	if (ROCKCHIP_SURFACE_LAYOUT_LINEAR == obj_surface->layout &&
+	    (DMA_MEMORY_CACHED == obj_surface->caching || chunk < 2)) {
+		get_image_convert(job, first_row, num_rows,
+		                  src_y, obj_surface->pitches[0],
+		                  src_uv, obj_surface->pitches[1]);
+		return;
+	}
 
-	x = (rx + 1) / 2 * (rect->width - 2 * SQUARE_SIZE) + SQUARE_SIZE;
-	y = (ry + 1) / 2 * (rect->height - 2 * SQUARE_SIZE) + SQUARE_SIZE;
+	/* Tiled frames are detiled a few whole tile rows at a time */
+	rockchip__surface_tile_size(obj_surface, &tile_width, &tile_height);
+	if (ROCKCHIP_SURFACE_LAYOUT_LINEAR != obj_surface->layout && chunk >= tile_height) {
+		chunk -= chunk % tile_height;
+		align = tile_height;
+	}
 
-	for(int i = MIN(SQUARE_SIZE, rect->width) - 1; i >= 0; i--)
-		for(int j = MIN(SQUARE_SIZE, rect->height) - 1; j >= 0; --j)
-			dst[Y][x + i + (y + j) * rect->width] = 255;
+	/* Pull a few rows at a time into cached memory, streamed or detiled */
+	for (row = 0; row < num_rows; row += n) {
+		n = MIN(chunk - ((job->rect.y + first_row + row) % align & ~1), num_rows - row);
+		if (ROCKCHIP_SURFACE_LAYOUT_LINEAR != obj_surface->layout) {
+			image_convert_detile_plane(bounce, stage_pitch,
+			                           obj_surface->data + obj_surface->offsets[0],
+			                           obj_surface->pitches[0], tile_width, tile_height,
+			                           job->rect.x, job->rect.y + first_row + row, job->width, n);
+			image_convert_detile_plane(bounce + chunk * stage_pitch, stage_pitch,
+			                           obj_surface->data + obj_surface->offsets[1],
+			                           obj_surface->pitches[1], tile_width, tile_height / 2,
+			                           job->rect.x & ~1, job->rect.y / 2 + (first_row + row) / 2,
+			                           (job->width + 1) & ~1, (n + 1) / 2);
+		} else {
+			image_convert_read_plane_uncached(bounce, stage_pitch,
+			                                  src_y + row * obj_surface->pitches[0],
+			                                  obj_surface->pitches[0], y_bytes, n);
+			image_convert_read_plane_uncached(bounce + chunk * stage_pitch, stage_pitch,
+			                                  src_uv + row / 2 * obj_surface->pitches[1],
+			                                  obj_surface->pitches[1], uv_bytes, (n + 1) / 2);
+		}
+		get_image_convert(job, first_row + row, n,
+		                  bounce, stage_pitch,
+		                  bounce + chunk * stage_pitch, stage_pitch);
+	}
+}
 
-	t++;
+/*
+ * Downscales in the same pass as the layout conversion. Sources are read
+ * in place whatever their caching, only the sampled lines are touched.
+ */
+static void
+get_image_yuv420_scaled_rows(void *arg, unsigned int first_row, unsigned int num_rows)
+{
+	const struct get_image_job * const job = arg;
+	const VAImage * const image = job->image;
+	const struct object_surface * const obj_surface = job->obj_surface;
+	const uint8_t *src_y, *src_uv;
+	uint8_t *dst_u, *dst_v;
+	unsigned int u_pitch, v_pitch, step;
+
+	src_y  = obj_surface->data + obj_surface->offsets[0] +
+	         job->rect.y * obj_surface->pitches[0] + job->rect.x;
+	src_uv = obj_surface->data + obj_surface->offsets[1] +
+	         (job->rect.y / 2) * obj_surface->pitches[1] + (job->rect.x & ~1);
+
+	switch (image->format.fourcc) {
+	case VA_FOURCC_NV12:
+		dst_u = job->image_data + image->offsets[1];
+		dst_v = dst_u + 1;
+		u_pitch = v_pitch = image->pitches[1];
+		step = 2;
+		break;
+	case VA_FOURCC_I420:
+		dst_u = job->image_data + image->offsets[1];
+		dst_v = job->image_data + image->offsets[2];
+		u_pitch = image->pitches[1];
+		v_pitch = image->pitches[2];
+		step = 1;
+		break;
+	case VA_FOURCC_YV12:
+		dst_v = job->image_data + image->offsets[1];
+		dst_u = job->image_data + image->offsets[2];
+		v_pitch = image->pitches[1];
+		u_pitch = image->pitches[2];
+		step = 1;
+		break;
+	default:
+		return;
+	}
 
-	return va_status;
+	image_convert_scale_plane(job->image_data + image->offsets[0], image->pitches[0], 1,
+	                          src_y, obj_surface->pitches[0], 1,
+	                          job->rect.width, job->rect.height, job->width, job->height,
+	                          first_row, num_rows);
+	image_convert_scale_plane(dst_u, u_pitch, step,
+	                          src_uv, obj_surface->pitches[1], 2,
+	                          (job->rect.width + 1) / 2, (job->rect.height + 1) / 2,
+	                          (job->width + 1) / 2, (job->height + 1) / 2,
+	                          first_row / 2, (num_rows + 1) / 2);
+	image_convert_scale_plane(dst_v, v_pitch, step,
+	                          src_uv + 1, obj_surface->pitches[1], 2,
+	                          (job->rect.width + 1) / 2, (job->rect.height + 1) / 2,
+	                          (job->width + 1) / 2, (job->height + 1) / 2,
+	                          first_row / 2, (num_rows + 1) / 2);
 }
 
+/*
+ * A region larger than the image is downscaled to fit it
+ */
 VAStatus rockchip_GetImage(
 	VADriverContextP ctx,
 	VASurfaceID surface,
@@ -636,10 +1261,13 @@ VAStatus rockchip_GetImage(
 {
 	INIT_DRIVER_DATA
 
-	VARectangle rect;
+	struct get_image_job job;
+	struct object_buffer *obj_buffer;
+	struct object_surface linear;
 	VAStatus va_status;
-	void *image_data = NULL;
-	
+	unsigned int first_row = 0, num_rows = 0;
+	int scaled;
+
 	struct object_surface * const obj_surface = SURFACE(surface);
 	struct object_image * const obj_image = IMAGE(image);
 
@@ -648,22 +1276,218 @@ VAStatus rockchip_GetImage(
 	if (!obj_image)
 			return VA_STATUS_ERROR_INVALID_IMAGE;
 
-	rect.x = x;
-	rect.y = y;
-	rect.width = width;
-	rect.height = height;
+	if (x < 0 || y < 0 || 0 == width || 0 == height ||
+	    x + width > (unsigned int) obj_surface->orig_width ||
+	    y + height > (unsigned int) obj_surface->orig_height)
+			return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+	va_status = rockchip__sync_surface(driver_data, obj_surface);
+	if (va_status != VA_STATUS_SUCCESS)
+			return va_status;
+
+	/* A derived image already is the surface */
+	if (obj_image->derived_surface == surface)
+			return (x || y) ? VA_STATUS_ERROR_INVALID_PARAMETER : VA_STATUS_SUCCESS;
+
+	obj_buffer = BUFFER(obj_image->image.buf);
+	if (!obj_buffer || !obj_buffer->buffer_data)
+			return VA_STATUS_ERROR_INVALID_BUFFER;
+
+	job.image = &obj_image->image;
+	job.image_data = obj_buffer->buffer_data;
+	job.obj_surface = obj_surface;
+	job.rect.x = x;
+	job.rect.y = y;
+	job.rect.width = width;
+	job.rect.height = height;
+	job.width = MIN(width, obj_image->image.width);
+	job.height = MIN(height, obj_image->image.height);
+	scaled = job.width != width || job.height != height;
+
+	if (ROCKCHIP_FOURCC_NV15 == obj_surface->fourcc) {
+		/* 10 bit surfaces are read back 1:1 into P010, in whole NV15 groups */
+		if (VA_FOURCC_P010 != obj_image->image.format.fourcc || scaled)
+			return VA_STATUS_ERROR_INVALID_IMAGE_FORMAT;
+		if (x & 3)
+			return VA_STATUS_ERROR_INVALID_PARAMETER;
+	} else {
+		/* Packed and high bit depth layouts are read back 1:1 only */
+		switch (obj_image->image.format.fourcc) {
+		case VA_FOURCC_NV12:
+		case VA_FOURCC_I420:
+		case VA_FOURCC_YV12:
+			break;
+		case VA_FOURCC_YUY2:
+		case VA_FOURCC_UYVY:
+		case VA_FOURCC_RGBX:
+		case VA_FOURCC_BGRX:
+		case VA_FOURCC_P010:
+			if (!scaled)
+				break;
+			/* fall through */
+		default:
+			return VA_STATUS_ERROR_INVALID_IMAGE_FORMAT;
+		}
+	}
 
-	va_status = rockchip_MapBuffer(ctx, obj_image->image.buf, &image_data);
-	va_status = get_image_i420(obj_image, image_data,
-           obj_surface, &rect);
+	/* 1:1 reads detile through the bounce buffer, others read a linear copy of the rect's rows */
+	if (ROCKCHIP_SURFACE_LAYOUT_LINEAR != obj_surface->layout &&
+	    (scaled || ALIGN((job.width + 1) & ~1, 64) * 3 > IMAGE_CONVERT_BOUNCE_SIZE)) {
+		first_row = y & ~1;
+		num_rows = ALIGN(y + height, 2) - first_row;
+		va_status = rockchip__begin_linear_access(driver_data, obj_surface, &linear, first_row, num_rows);
+		if (va_status != VA_STATUS_SUCCESS)
+			return va_status;
+		job.obj_surface = &linear;
+	}
 
-	va_status = rockchip_UnmapBuffer(ctx, obj_image->image.buf);
+	copy_engine_run(&driver_data->copy_engine,
+	                scaled ? get_image_yuv420_scaled_rows : get_image_rows,
+	                &job, job.height, width * 3 / 2 * (height / job.height));
 
-	return va_status;
+	if (job.obj_surface != obj_surface)
+		rockchip__end_linear_access(driver_data, obj_surface, &linear, 0, 0);
 
-    return VA_STATUS_SUCCESS;
+	return VA_STATUS_SUCCESS;
 }
 
+/*
+ * An upload of the src rect of an image into the dst rect of a surface
+ * frame, run by the copy engine in bands of surface rows
+ */
+struct put_image_job {
+	const VAImage *image;
+	const uint8_t *image_data;
+	const struct object_surface *obj_surface;
+	VARectangle src;
+	VARectangle dst;
+};
+
+/*
+ * Image planes at luma row row of the source rect. step is the byte
+ * distance between chroma samples.
+ */
+static void
+put_image_source_planes(const struct put_image_job *job, unsigned int row,
+                        const uint8_t **y, const uint8_t **u, const uint8_t **v,
+                        unsigned int *u_pitch, unsigned int *v_pitch, unsigned int *step)
+{
+	const VAImage * const image = job->image;
+	const unsigned int uv_row = (job->src.y + row) / 2;
+
+	*y = job->image_data + image->offsets[0] + (job->src.y + row) * image->pitches[0] + job->src.x;
+
+	switch (image->format.fourcc) {
+	case VA_FOURCC_NV12:
+		*u = job->image_data + image->offsets[1] + uv_row * image->pitches[1] + (job->src.x & ~1);
+		*v = *u + 1;
+		*u_pitch = *v_pitch = image->pitches[1];
+		*step = 2;
+		break;
+	case VA_FOURCC_P010:
+		*y = job->image_data + image->offsets[0] + (job->src.y + row) * image->pitches[0] + job->src.x * 2;
+		*u = job->image_data + image->offsets[1] + uv_row * image->pitches[1] + (job->src.x & ~1) * 2;
+		*v = *u + 2;
+		*u_pitch = *v_pitch = image->pitches[1];
+		*step = 4;
+		break;
+	case VA_FOURCC_YV12:
+		*v = job->image_data + image->offsets[1] + uv_row * image->pitches[1] + job->src.x / 2;
+		*u = job->image_data + image->offsets[2] + uv_row * image->pitches[2] + job->src.x / 2;
+		*v_pitch = image->pitches[1];
+		*u_pitch = image->pitches[2];
+		*step = 1;
+		break;
+	default: /* VA_FOURCC_I420 */
+		*u = job->image_data + image->offsets[1] + uv_row * image->pitches[1] + job->src.x / 2;
+		*v = job->image_data + image->offsets[2] + uv_row * image->pitches[2] + job->src.x / 2;
+		*u_pitch = image->pitches[1];
+		*v_pitch = image->pitches[2];
+		*step = 1;
+		break;
+	}
+}
+
+static void
+put_image_yuv420_rows(void *arg, unsigned int first_row, unsigned int num_rows)
+{
+	const struct put_image_job * const job = arg;
+	const struct object_surface * const obj_surface = job->obj_surface;
+	const uint8_t *src_y, *src_u, *src_v;
+	unsigned int u_pitch, v_pitch, step;
+	uint8_t *dst_y, *dst_uv;
+
+	put_image_source_planes(job, first_row, &src_y, &src_u, &src_v, &u_pitch, &v_pitch, &step);
+	dst_y  = obj_surface->data + obj_surface->offsets[0] +
+	         (job->dst.y + first_row) * obj_surface->pitches[0] +
+	         rockchip__surface_row_bytes(obj_surface, job->dst.x);
+	dst_uv = obj_surface->data + obj_surface->offsets[1] +
+	         ((job->dst.y + first_row) / 2) * obj_surface->pitches[1] +
+	         rockchip__surface_row_bytes(obj_surface, job->dst.x & ~1);
+
+	/* P010 into a 10 bit surface */
+	if (ROCKCHIP_FOURCC_NV15 == obj_surface->fourcc) {
+		image_convert_p010_to_nv15(dst_y, obj_surface->pitches[0],
+		                           dst_uv, obj_surface->pitches[1],
+		                           src_y, job->image->pitches[0],
+		                           src_u, u_pitch,
+		                           ALIGN(job->dst.width, 4), num_rows);
+		return;
+	}
+
+	/* Matching layouts are straight copies */
+	if (2 == step) {
+		image_convert_copy_plane(dst_y, obj_surface->pitches[0],
+		                         src_y, job->image->pitches[0],
+		                         job->dst.width, num_rows);
+		image_convert_copy_plane(dst_uv, obj_surface->pitches[1],
+		                         src_u, u_pitch,
+		                         (job->dst.width + 1) & ~1, (num_rows + 1) / 2);
+		return;
+	}
+
+	image_convert_yuv420_to_nv12(dst_y, obj_surface->pitches[0],
+	                             dst_uv, obj_surface->pitches[1],
+	                             src_y, job->image->pitches[0],
+	                             src_u, u_pitch, src_v, v_pitch,
+	                             job->dst.width, num_rows);
+}
+
+static void
+put_image_yuv420_scaled_rows(void *arg, unsigned int first_row, unsigned int num_rows)
+{
+	const struct put_image_job * const job = arg;
+	const struct object_surface * const obj_surface = job->obj_surface;
+	const uint8_t *src_y, *src_u, *src_v;
+	unsigned int u_pitch, v_pitch, step;
+	uint8_t *dst_y, *dst_uv;
+
+	put_image_source_planes(job, 0, &src_y, &src_u, &src_v, &u_pitch, &v_pitch, &step);
+	dst_y  = obj_surface->data + obj_surface->offsets[0] +
+	         job->dst.y * obj_surface->pitches[0] + job->dst.x;
+	dst_uv = obj_surface->data + obj_surface->offsets[1] +
+	         (job->dst.y / 2) * obj_surface->pitches[1] + (job->dst.x & ~1);
+
+	image_convert_scale_plane(dst_y, obj_surface->pitches[0], 1,
+	                          src_y, job->image->pitches[0], 1,
+	                          job->src.width, job->src.height,
+	                          job->dst.width, job->dst.height,
+	                          first_row, num_rows);
+	image_convert_scale_plane(dst_uv, obj_surface->pitches[1], 2,
+	                          src_u, u_pitch, step,
+	                          (job->src.width + 1) / 2, (job->src.height + 1) / 2,
+	                          (job->dst.width + 1) / 2, (job->dst.height + 1) / 2,
+	                          first_row / 2, (num_rows + 1) / 2);
+	image_convert_scale_plane(dst_uv + 1, obj_surface->pitches[1], 2,
+	                          src_v, v_pitch, step,
+	                          (job->src.width + 1) / 2, (job->src.height + 1) / 2,
+	                          (job->dst.width + 1) / 2, (job->dst.height + 1) / 2,
+	                          first_row / 2, (num_rows + 1) / 2);
+}
+
+/*
+ * The src rect is scaled to the dest rect when their sizes differ
+ */
 VAStatus rockchip_PutImage(
 	VADriverContextP ctx,
 	VASurfaceID surface,
@@ -678,8 +1502,102 @@ VAStatus rockchip_PutImage(
 	unsigned int dest_height
 )
 {
-    /* TODO */
-    return VA_STATUS_SUCCESS;
+	INIT_DRIVER_DATA
+
+	struct put_image_job job;
+	struct object_buffer *obj_buffer;
+	struct object_surface linear;
+	VAStatus va_status;
+	unsigned int first_row, num_rows;
+
+	struct object_surface * const obj_surface = SURFACE(surface);
+	struct object_image * const obj_image = IMAGE(image);
+
+	if (!obj_surface)
+			return VA_STATUS_ERROR_INVALID_SURFACE;
+	if (!obj_image)
+			return VA_STATUS_ERROR_INVALID_IMAGE;
+
+	if (src_x < 0 || src_y < 0 || 0 == src_width || 0 == src_height ||
+	    src_x + src_width > obj_image->image.width ||
+	    src_y + src_height > obj_image->image.height ||
+	    dest_x < 0 || dest_y < 0 || 0 == dest_width || 0 == dest_height ||
+	    dest_x + dest_width > (unsigned int) obj_surface->orig_width ||
+	    dest_y + dest_height > (unsigned int) obj_surface->orig_height)
+			return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+	va_status = rockchip__sync_surface(driver_data, obj_surface);
+	if (va_status != VA_STATUS_SUCCESS)
+			return va_status;
+
+	/* A derived image already is the surface */
+	if (obj_image->derived_surface == surface)
+			return (src_x == dest_x && src_y == dest_y &&
+			        src_width == dest_width && src_height == dest_height) ?
+			       VA_STATUS_SUCCESS : VA_STATUS_ERROR_INVALID_PARAMETER;
+
+	obj_buffer = BUFFER(obj_image->image.buf);
+	if (!obj_buffer || !obj_buffer->buffer_data)
+			return VA_STATUS_ERROR_INVALID_BUFFER;
+
+	if (ROCKCHIP_FOURCC_NV15 == obj_surface->fourcc) {
+		/* 10 bit surfaces take P010 1:1, in whole NV15 groups */
+		if (VA_FOURCC_P010 != obj_image->image.format.fourcc ||
+		    src_width != dest_width || src_height != dest_height)
+			return VA_STATUS_ERROR_INVALID_IMAGE_FORMAT;
+		if (dest_x & 3)
+			return VA_STATUS_ERROR_INVALID_PARAMETER;
+	} else {
+		switch (obj_image->image.format.fourcc) {
+		case VA_FOURCC_NV12:
+		case VA_FOURCC_I420:
+		case VA_FOURCC_YV12:
+			break;
+		default:
+			return VA_STATUS_ERROR_INVALID_IMAGE_FORMAT;
+		}
+	}
+
+	job.image = &obj_image->image;
+	job.image_data = obj_buffer->buffer_data;
+	job.obj_surface = obj_surface;
+
+	/*
+	 * Tiled frames are written through a linear copy of the rows under
+	 * the rect, tiled back afterwards. Their old pixels only matter
+	 * around the rect, a whole frame upload skips the detiling.
+	 */
+	first_row = dest_y & ~1;
+	num_rows = ALIGN(dest_y + dest_height, 2) - first_row;
+	if (ROCKCHIP_SURFACE_LAYOUT_LINEAR != obj_surface->layout) {
+		va_status = rockchip__begin_linear_access(driver_data, obj_surface, &linear, first_row,
+		                                          (0 == dest_x && 0 == dest_y &&
+		                                           dest_width == (unsigned int) obj_surface->orig_width &&
+		                                           dest_height == (unsigned int) obj_surface->orig_height) ?
+		                                          0 : num_rows);
+		if (va_status != VA_STATUS_SUCCESS)
+			return va_status;
+		job.obj_surface = &linear;
+	}
+
+	job.src.x = src_x;
+	job.src.y = src_y;
+	job.src.width = src_width;
+	job.src.height = src_height;
+	job.dst.x = dest_x;
+	job.dst.y = dest_y;
+	job.dst.width = dest_width;
+	job.dst.height = dest_height;
+
+	copy_engine_run(&driver_data->copy_engine,
+	                (src_width == dest_width && src_height == dest_height) ?
+	                put_image_yuv420_rows : put_image_yuv420_scaled_rows,
+	                &job, dest_height, dest_width * 3 / 2);
+
+	if (job.obj_surface != obj_surface)
+		rockchip__end_linear_access(driver_data, obj_surface, &linear, first_row, num_rows);
+
+	return VA_STATUS_SUCCESS;
 }
 
 VAStatus rockchip_QuerySubpictureFormats(
@@ -780,19 +1698,152 @@ VAStatus rockchip_AssociateSubpicture(
 	unsigned int flags
 )
 {
-    /* TODO */
-    return VA_STATUS_SUCCESS;
+    /* TODO */
+    return VA_STATUS_SUCCESS;
+}
+
+VAStatus rockchip_DeassociateSubpicture(
+	VADriverContextP ctx,
+	VASubpictureID subpicture,
+	VASurfaceID *target_surfaces,
+	int num_surfaces
+)
+{
+    /* TODO */
+    return VA_STATUS_SUCCESS;
+}
+
+static inline uint64_t rockchip__now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Bytes of slices [first, last) of a picture */
+static uint64_t rockchip__slice_bytes(const struct bitstream_arena *bitstream, int first, int last)
+{
+    uint64_t size = 0;
+
+    for (; first < last; first++)
+    {
+        size += bitstream->slices[first].size;
+    }
+    return size;
+}
+
+/*
+ * Decoder side of size bytes of slice data. The placeholder decoder
+ * takes no time unless ROCKCHIP_VA_DECODE_RATE gives it a throughput,
+ * then it spends what a decoder of that rate would.
+ */
+static void rockchip__decode_slices(struct rockchip_driver_data *driver_data, uint64_t size)
+{
+    struct timespec ts;
+    uint64_t ns;
+
+    if (0 == driver_data->decode_rate)
+    {
+        return;
+    }
+
+    /* One MB/s is one byte per microsecond */
+    ns = size * 1000 / driver_data->decode_rate;
+    ts.tv_sec = ns / 1000000000;
+    ts.tv_nsec = ns % 1000000000;
+    nanosleep(&ts, NULL);
+}
+
+/*
+ * Worker side of a ring slot. The bitstream is handed to the decoder
+ * here, in low latency mode slice by slice as they arrive, so decoding
+ * overlaps with the upload of the rest of the picture. Once the frame
+ * is out the surface is ready and the slot goes back to the context.
+ */
+static void rockchip__decode_picture(void *arg, unsigned int slot)
+{
+    object_context_p obj_context = arg;
+    struct rockchip_picture * const picture = &obj_context->pictures[slot];
+    struct rockchip_driver_data * const driver_data = picture->driver_data;
+    uint64_t now, latency, size;
+
+    if (obj_context->low_latency)
+    {
+        decode_worker_lock(&obj_context->worker);
+        while (!picture->complete || picture->num_slices_sent < picture->num_slices_ready)
+        {
+            if (picture->num_slices_sent == picture->num_slices_ready)
+            {
+                decode_worker_wait(&obj_context->worker);
+                continue;
+            }
+            /*
+             * Slices [num_slices_sent, num_slices_ready) go to the decoder, the next ones arrive
+             * meanwhile. Appending them doesn't move the data of these.
+             */
+            size = rockchip__slice_bytes(&picture->bitstream, picture->num_slices_sent, picture->num_slices_ready);
+            picture->num_slices_sent = picture->num_slices_ready;
+            decode_worker_unlock(&obj_context->worker);
+            rockchip__decode_slices(driver_data, size);
+            decode_worker_lock(&obj_context->worker);
+        }
+        decode_worker_unlock(&obj_context->worker);
+    }
+    else
+    {
+        rockchip__decode_slices(driver_data, rockchip__slice_bytes(&picture->bitstream, 0, picture->bitstream.num_slices));
+    }
+
+    /* The backend writes the frame in its own layout, the surface only takes the label */
+    if (picture->layout >= 0)
+    {
+        picture->surface->layout = picture->layout;
+    }
+
+    now = rockchip__now();
+    latency = now - picture->begin_time;
+    obj_context->decoded++;
+    obj_context->latency_sum += latency;
+    if (latency > obj_context->latency_max)
+    {
+        obj_context->latency_max = latency;
+    }
+    obj_context->tail_sum += now - picture->end_time;
+
+    pthread_mutex_lock(&driver_data->decode_mutex);
+    picture->surface->pending--;
+    pthread_cond_broadcast(&driver_data->decode_cond);
+    pthread_mutex_unlock(&driver_data->decode_mutex);
 }
 
-VAStatus rockchip_DeassociateSubpicture(
-	VADriverContextP ctx,
-	VASubpictureID subpicture,
-	VASurfaceID *target_surfaces,
-	int num_surfaces
-)
+/* Low latency mode: the worker has every slice of the current picture */
+static void rockchip__complete_picture(object_context_p obj_context)
 {
-    /* TODO */
-    return VA_STATUS_SUCCESS;
+    struct rockchip_picture * const picture = obj_context->picture;
+    struct rockchip_driver_data * const driver_data = picture->driver_data;
+
+    /* From here on the surface can be waited for */
+    pthread_mutex_lock(&driver_data->decode_mutex);
+    picture->surface->streaming--;
+    pthread_mutex_unlock(&driver_data->decode_mutex);
+
+    decode_worker_lock(&obj_context->worker);
+    picture->end_time = rockchip__now();
+    picture->complete = 1;
+    decode_worker_notify(&obj_context->worker);
+    decode_worker_unlock(&obj_context->worker);
+}
+
+static void rockchip__destroy_pictures(struct rockchip_picture *pictures, unsigned int depth)
+{
+    unsigned int i;
+
+    for (i = 0; i < depth; i++)
+    {
+        bitstream_arena_destroy(&pictures[i].bitstream);
+    }
+    free(pictures);
 }
 
 VAStatus rockchip_CreateContext(
@@ -809,6 +1860,8 @@ VAStatus rockchip_CreateContext(
     INIT_DRIVER_DATA
     VAStatus vaStatus = VA_STATUS_SUCCESS;
     object_config_p obj_config;
+    unsigned int depth = ROCKCHIP_DECODE_DEPTH;
+    int low_latency = 0;
     int i;
 
     obj_config = CONFIG(config_id);
@@ -818,6 +1871,23 @@ VAStatus rockchip_CreateContext(
         return vaStatus;
     }
 
+    for (i = 0; i < obj_config->attrib_count; i++)
+    {
+        if (ROCKCHIP_CONFIG_ATTRIB_DECODE_DEPTH == obj_config->attrib_list[i].type)
+        {
+            depth = obj_config->attrib_list[i].value;
+        }
+        else if (ROCKCHIP_CONFIG_ATTRIB_LOW_LATENCY == obj_config->attrib_list[i].type)
+        {
+            low_latency = obj_config->attrib_list[i].value;
+        }
+    }
+    /* No queueing behind other pictures in low latency mode */
+    if (low_latency)
+    {
+        depth = 1;
+    }
+
     /* Validate flag */
     /* Validate picture dimensions */
 
@@ -832,6 +1902,13 @@ VAStatus rockchip_CreateContext(
     obj_context->context_id  = contextID;
     *context = contextID;
     obj_context->current_render_target = -1;
+    obj_context->picture = NULL;
+    obj_context->pictures = NULL;
+    obj_context->low_latency = low_latency;
+    obj_context->decoded = 0;
+    obj_context->latency_sum = 0;
+    obj_context->latency_max = 0;
+    obj_context->tail_sum = 0;
     obj_context->config_id = config_id;
     obj_context->picture_width = picture_width;
     obj_context->picture_height = picture_height;
@@ -854,6 +1931,28 @@ VAStatus rockchip_CreateContext(
     }
     obj_context->flags = flag;
 
+    /* Ring slots, each with its own bitstream storage */
+    if (VA_STATUS_SUCCESS == vaStatus)
+    {
+        obj_context->pictures = calloc(depth, sizeof(struct rockchip_picture));
+        if (NULL == obj_context->pictures)
+        {
+            vaStatus = VA_STATUS_ERROR_ALLOCATION_FAILED;
+        }
+    }
+    if (VA_STATUS_SUCCESS == vaStatus)
+    {
+        for (i = 0; i < (int) depth; i++)
+        {
+            obj_context->pictures[i].driver_data = driver_data;
+            bitstream_arena_init(&obj_context->pictures[i].bitstream, &driver_data->dma_cache);
+        }
+        if (decode_worker_init(&obj_context->worker, depth, rockchip__decode_picture, obj_context))
+        {
+            vaStatus = VA_STATUS_ERROR_ALLOCATION_FAILED;
+        }
+    }
+
     /* Error recovery */
     if (VA_STATUS_SUCCESS != vaStatus)
     {
@@ -863,21 +1962,51 @@ VAStatus rockchip_CreateContext(
         obj_context->render_targets = NULL;
         obj_context->num_render_targets = 0;
         obj_context->flags = 0;
+        if (obj_context->pictures)
+        {
+            rockchip__destroy_pictures(obj_context->pictures, depth);
+            obj_context->pictures = NULL;
+        }
         object_heap_free( &driver_data->context_heap, (object_base_p) obj_context);
     }
 
     return vaStatus;
 }
 
-
-VAStatus rockchip_DestroyContext(
-		VADriverContextP ctx,
-		VAContextID context
-	)
+/*
+ * Lets the worker finish the pictures still queued, then releases the
+ * context with its ring slots. The queue and latency statistics,
+ * printed with ROCKCHIP_VA_DEBUG, help to pick the depth and mode for
+ * a stream type.
+ */
+static void rockchip__destroy_context(struct rockchip_driver_data *driver_data, object_context_p obj_context)
 {
-    INIT_DRIVER_DATA
-    object_context_p obj_context = CONTEXT(context);
-    ASSERT(obj_context);
+    decode_worker_p worker = &obj_context->worker;
+
+    if (obj_context->low_latency && obj_context->picture)
+    {
+        rockchip__complete_picture(obj_context);
+    }
+    decode_worker_destroy(worker);
+    if (driver_data->debug)
+    {
+        rockchip__information_message("decode queue: %lu pictures, %.2f in flight on average, "
+                                      "at most %u of %u, %lu stalls on a full ring\n",
+                                      worker->submitted,
+                                      worker->submitted ? (double) worker->depth_sum / worker->submitted : 0.0,
+                                      worker->max_depth, worker->depth, worker->stalls);
+    }
+    if (driver_data->debug && obj_context->decoded)
+    {
+        rockchip__information_message("decode latency%s: %.3f ms average, %.3f ms at most, "
+                                      "%.3f ms average after vaEndPicture\n",
+                                      obj_context->low_latency ? " (low latency)" : "",
+                                      obj_context->latency_sum / 1e6 / obj_context->decoded,
+                                      obj_context->latency_max / 1e6,
+                                      obj_context->tail_sum / 1e6 / obj_context->decoded);
+    }
+    rockchip__destroy_pictures(obj_context->pictures, worker->depth);
+    obj_context->pictures = NULL;
 
     obj_context->context_id = -1;
     obj_context->config_id = -1;
@@ -892,19 +2021,45 @@ VAStatus rockchip_DestroyContext(
     obj_context->flags = 0;
 
     obj_context->current_render_target = -1;
+    obj_context->picture = NULL;
 
     object_heap_free( &driver_data->context_heap, (object_base_p) obj_context);
+}
+
+VAStatus rockchip_DestroyContext(
+		VADriverContextP ctx,
+		VAContextID context
+	)
+{
+    INIT_DRIVER_DATA
+    object_context_p obj_context = CONTEXT(context);
+    ASSERT(obj_context);
+
+    rockchip__destroy_context(driver_data, obj_context);
 
     return VA_STATUS_SUCCESS;
 }
 
 
 
-static VAStatus rockchip__allocate_buffer(object_buffer_p obj_buffer, int size)
+/*
+ * Buffers the client fills through vaMapBuffer that a device then reads
+ * get shareable memory, so the client writes straight into what the
+ * decoder consumes. Everything else comes from the buffer pool.
+ */
+static VAStatus rockchip__allocate_buffer(struct rockchip_driver_data *driver_data, object_buffer_p obj_buffer, int size, int shareable)
 {
     VAStatus vaStatus = VA_STATUS_SUCCESS;
 
-    obj_buffer->buffer_data = realloc(obj_buffer->buffer_data, size);
+    obj_buffer->mem_type = ROCKCHIP_BUFFER_MEM_POOL;
+    if (shareable && 0 == dma_memory_alloc(&driver_data->dma_cache, &obj_buffer->dma, size))
+    {
+        obj_buffer->mem_type = ROCKCHIP_BUFFER_MEM_DMA;
+        obj_buffer->buffer_data = obj_buffer->dma.data;
+        return vaStatus;
+    }
+
+    obj_buffer->buffer_data = buffer_pool_alloc(&driver_data->buffer_pool, obj_buffer->type, size);
     if (NULL == obj_buffer->buffer_data)
     {
         vaStatus = VA_STATUS_ERROR_ALLOCATION_FAILED;
@@ -956,8 +2111,14 @@ VAStatus rockchip_CreateBuffer(
     }
 
     obj_buffer->buffer_data = NULL;
-
-    vaStatus = rockchip__allocate_buffer(obj_buffer, size * num_elements);
+    obj_buffer->type = type;
+    obj_buffer->size = size;
+    obj_buffer->export_count = 0;
+    obj_buffer->exported = 0;
+
+    vaStatus = rockchip__allocate_buffer(driver_data, obj_buffer, size * num_elements,
+                                         NULL == data && (VASliceDataBufferType == type ||
+                                                          VAImageBufferType == type));
     if (VA_STATUS_SUCCESS == vaStatus)
     {
         obj_buffer->max_num_elements = num_elements;
@@ -1033,14 +2194,36 @@ VAStatus rockchip_UnmapBuffer(
     return VA_STATUS_SUCCESS;
 }
 
-static void rockchip__destroy_buffer(struct rockchip_driver_data *driver_data, object_buffer_p obj_buffer)
+static void rockchip__release_buffer_data(struct rockchip_driver_data *driver_data, object_buffer_p obj_buffer)
 {
-    if (NULL != obj_buffer->buffer_data)
+    if (NULL == obj_buffer->buffer_data)
+    {
+        return;
+    }
+
+    if (ROCKCHIP_BUFFER_MEM_SURFACE == obj_buffer->mem_type)
+    {
+        /* The surface owns the frame */
+    }
+    else if (ROCKCHIP_BUFFER_MEM_DMA == obj_buffer->mem_type && obj_buffer->exported)
+    {
+        dma_memory_destroy(&obj_buffer->dma);
+    }
+    else if (ROCKCHIP_BUFFER_MEM_DMA == obj_buffer->mem_type)
+    {
+        dma_memory_free(&driver_data->dma_cache, &obj_buffer->dma);
+    }
+    else
     {
-        free(obj_buffer->buffer_data);
-        obj_buffer->buffer_data = NULL;
+        buffer_pool_free(&driver_data->buffer_pool, obj_buffer->type,
+                         obj_buffer->size * obj_buffer->max_num_elements, obj_buffer->buffer_data);
     }
+    obj_buffer->buffer_data = NULL;
+}
 
+static void rockchip__destroy_buffer(struct rockchip_driver_data *driver_data, object_buffer_p obj_buffer)
+{
+    rockchip__release_buffer_data(driver_data, obj_buffer);
     object_heap_free( &driver_data->buffer_heap, (object_base_p) obj_buffer);
 }
 
@@ -1058,6 +2241,31 @@ VAStatus rockchip_DestroyBuffer(
     return VA_STATUS_SUCCESS;
 }
 
+/* Hands the context's current picture to the worker */
+static void rockchip__submit_picture(struct rockchip_driver_data *driver_data, object_context_p obj_context,
+                                     object_surface_p obj_surface)
+{
+    struct rockchip_picture * const picture = obj_context->picture;
+
+    /* 8 bit frames come out in the configured layout */
+    picture->surface = obj_surface;
+    picture->layout = -1;
+    if (VA_FOURCC_NV12 == obj_surface->fourcc)
+    {
+        picture->layout = driver_data->surface_layout;
+    }
+
+    pthread_mutex_lock(&driver_data->decode_mutex);
+    obj_surface->pending++;
+    if (obj_context->low_latency)
+    {
+        obj_surface->streaming++;
+    }
+    pthread_mutex_unlock(&driver_data->decode_mutex);
+
+    decode_worker_submit(&obj_context->worker);
+}
+
 VAStatus rockchip_BeginPicture(
 		VADriverContextP ctx,
 		VAContextID context,
@@ -1075,7 +2283,26 @@ VAStatus rockchip_BeginPicture(
     obj_surface = SURFACE(render_target);
     ASSERT(obj_surface);
 
+    /* A streamed picture that never saw vaEndPicture is decoded with what it got */
+    if (obj_context->low_latency && obj_context->picture)
+    {
+        rockchip__complete_picture(obj_context);
+    }
+
+    /* Waits while every slot is in flight */
     obj_context->current_render_target = obj_surface->base.id;
+    obj_context->picture = &obj_context->pictures[decode_worker_acquire(&obj_context->worker)];
+    bitstream_arena_reset(&obj_context->picture->bitstream);
+    obj_context->picture->begin_time = rockchip__now();
+
+    /* In low latency mode the worker follows the picture from the start */
+    if (obj_context->low_latency)
+    {
+        obj_context->picture->num_slices_ready = 0;
+        obj_context->picture->num_slices_sent = 0;
+        obj_context->picture->complete = 0;
+        rockchip__submit_picture(driver_data, obj_context, obj_surface);
+    }
 
     return vaStatus;
 }
@@ -1091,6 +2318,8 @@ VAStatus rockchip_RenderPicture(
     VAStatus vaStatus = VA_STATUS_SUCCESS;
     object_context_p obj_context;
     object_surface_p obj_surface;
+    object_base_p batch[ROCKCHIP_BATCH_SIZE];
+    object_base_p *obj_buffers = batch;
     int i;
 
     obj_context = CONTEXT(context);
@@ -1099,26 +2328,74 @@ VAStatus rockchip_RenderPicture(
     obj_surface = SURFACE(obj_context->current_render_target);
     ASSERT(obj_surface);
 
-    /* verify that we got valid buffer references */
-    for(i = 0; i < num_buffers; i++)
+    if (num_buffers > ROCKCHIP_BATCH_SIZE)
     {
-        object_buffer_p obj_buffer = BUFFER(buffers[i]);
-        ASSERT(obj_buffer);
-        if (NULL == obj_buffer)
+        obj_buffers = malloc(num_buffers * sizeof(object_base_p));
+        if (NULL == obj_buffers)
         {
-            vaStatus = VA_STATUS_ERROR_INVALID_BUFFER;
-            break;
+            return VA_STATUS_ERROR_ALLOCATION_FAILED;
         }
     }
-    
-    /* Release buffers */
-    for(i = 0; i < num_buffers; i++)
+
+    /* verify that we got valid buffer references */
+    if (-1 == object_heap_lookup_n( &driver_data->buffer_heap, (int *) buffers, num_buffers, obj_buffers ))
     {
-        object_buffer_p obj_buffer = BUFFER(buffers[i]);
-        ASSERT(obj_buffer);
-        rockchip__destroy_buffer(driver_data, obj_buffer);
+        vaStatus = VA_STATUS_ERROR_INVALID_BUFFER;
+    }
+    else
+    {
+        /*
+         * Gather slice data into the picture's bitstream. Slices
+         * already in shareable memory are handed over as they are. In
+         * low latency mode the worker takes them from there right away.
+         */
+        if (obj_context->low_latency)
+        {
+            decode_worker_lock(&obj_context->worker);
+        }
+        for(i = 0; i < num_buffers; i++)
+        {
+            object_buffer_p obj_buffer = (object_buffer_p) obj_buffers[i];
+            unsigned int size = obj_buffer->size * obj_buffer->num_elements;
+
+            if (VASliceDataBufferType != obj_buffer->type)
+            {
+                continue;
+            }
+
+            if (ROCKCHIP_BUFFER_MEM_DMA == obj_buffer->mem_type && !obj_buffer->exported)
+            {
+                if (0 == bitstream_arena_attach(&obj_context->picture->bitstream, &obj_buffer->dma, size))
+                {
+                    obj_buffer->buffer_data = NULL;
+                    continue;
+                }
+            }
+            else if (0 == bitstream_arena_append(&obj_context->picture->bitstream, obj_buffer->buffer_data, size))
+            {
+                continue;
+            }
+            vaStatus = VA_STATUS_ERROR_ALLOCATION_FAILED;
+        }
+        if (obj_context->low_latency)
+        {
+            obj_context->picture->num_slices_ready = obj_context->picture->bitstream.num_slices;
+            decode_worker_notify(&obj_context->worker);
+            decode_worker_unlock(&obj_context->worker);
+        }
+
+        /* Release buffers */
+        for(i = 0; i < num_buffers; i++)
+        {
+            rockchip__release_buffer_data(driver_data, (object_buffer_p) obj_buffers[i]);
+        }
+        object_heap_free_n( &driver_data->buffer_heap, obj_buffers, num_buffers );
     }
 
+    if (obj_buffers != batch)
+    {
+        free(obj_buffers);
+    }
     return vaStatus;
 }
 
@@ -1138,7 +2415,20 @@ VAStatus rockchip_EndPicture(
     obj_surface = SURFACE(obj_context->current_render_target);
     ASSERT(obj_surface);
 
-    // For now, assume that we are done with rendering right away
+    /*
+     * The slot's bitstream now holds all slice data of the picture as a
+     * single linear buffer with its slice table, ready for the decoder.
+     */
+    if (obj_context->low_latency)
+    {
+        rockchip__complete_picture(obj_context);
+    }
+    else
+    {
+        obj_context->picture->end_time = rockchip__now();
+        rockchip__submit_picture(driver_data, obj_context, obj_surface);
+    }
+    obj_context->picture = NULL;
     obj_context->current_render_target = -1;
 
     return vaStatus;
@@ -1157,6 +2447,8 @@ VAStatus rockchip_SyncSurface(
     obj_surface = SURFACE(render_target);
     ASSERT(obj_surface);
 
+    vaStatus = rockchip__sync_surface(driver_data, obj_surface);
+
     return vaStatus;
 }
 
@@ -1173,7 +2465,9 @@ VAStatus rockchip_QuerySurfaceStatus(
     obj_surface = SURFACE(render_target);
     ASSERT(obj_surface);
 
-    *status = VASurfaceReady;
+    pthread_mutex_lock(&driver_data->decode_mutex);
+    *status = obj_surface->pending ? VASurfaceRendering : VASurfaceReady;
+    pthread_mutex_unlock(&driver_data->decode_mutex);
 
     return vaStatus;
 }
@@ -1256,9 +2550,99 @@ VAStatus rockchip_BufferInfo(
         unsigned int *num_elements /* out */
     )
 {
-    /* TODO */
-    return VA_STATUS_ERROR_UNIMPLEMENTED;
+    INIT_DRIVER_DATA
+    object_buffer_p obj_buffer = BUFFER(buf_id);
+    if (NULL == obj_buffer)
+    {
+        return VA_STATUS_ERROR_INVALID_BUFFER;
+    }
+
+    *type = obj_buffer->type;
+    *size = obj_buffer->size;
+    *num_elements = obj_buffer->num_elements;
+    return VA_STATUS_SUCCESS;
+}
+
+#if VA_CHECK_VERSION(0,36,0)
+/*
+ * Exports a buffer as a DRM PRIME fd: the udmabuf dma-buf when the kernel
+ * provides one, the memfd otherwise. Buffers living in pool memory are
+ * moved to shareable memory on first export. The fd stays owned by the
+ * driver and valid until the matching vaReleaseBufferHandle.
+ */
+VAStatus rockchip_AcquireBufferHandle(
+        VADriverContextP ctx,
+        VABufferID buf_id,	/* in */
+        VABufferInfo *buf_info	/* in/out */
+    )
+{
+    INIT_DRIVER_DATA
+    object_buffer_p obj_buffer = BUFFER(buf_id);
+    unsigned int data_size;
+
+    if (NULL == obj_buffer || NULL == obj_buffer->buffer_data)
+    {
+        return VA_STATUS_ERROR_INVALID_BUFFER;
+    }
+
+    if (buf_info->mem_type && !(buf_info->mem_type & VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME))
+    {
+        return VA_STATUS_ERROR_UNSUPPORTED_MEMORY_TYPE;
+    }
+
+    /* Derived image buffers alias arena memory, which has no fd */
+    if (ROCKCHIP_BUFFER_MEM_SURFACE == obj_buffer->mem_type)
+    {
+        return VA_STATUS_ERROR_UNSUPPORTED_MEMORY_TYPE;
+    }
+
+    data_size = obj_buffer->size * obj_buffer->max_num_elements;
+    if (ROCKCHIP_BUFFER_MEM_POOL == obj_buffer->mem_type)
+    {
+        struct dma_memory dma;
+
+        if (-1 == dma_memory_alloc(&driver_data->dma_cache, &dma, data_size))
+        {
+            return VA_STATUS_ERROR_ALLOCATION_FAILED;
+        }
+        memcpy(dma.data, obj_buffer->buffer_data, data_size);
+        rockchip__release_buffer_data(driver_data, obj_buffer);
+        obj_buffer->dma = dma;
+        obj_buffer->buffer_data = dma.data;
+        obj_buffer->mem_type = ROCKCHIP_BUFFER_MEM_DMA;
+    }
+
+    obj_buffer->export_count++;
+    obj_buffer->exported = 1;
+
+    buf_info->handle = (uintptr_t) dma_memory_fd(&obj_buffer->dma);
+    buf_info->type = obj_buffer->type;
+    buf_info->mem_type = VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME;
+    buf_info->mem_size = obj_buffer->dma.size;
+    return VA_STATUS_SUCCESS;
+}
+
+VAStatus rockchip_ReleaseBufferHandle(
+        VADriverContextP ctx,
+        VABufferID buf_id	/* in */
+    )
+{
+    INIT_DRIVER_DATA
+    object_buffer_p obj_buffer = BUFFER(buf_id);
+
+    if (NULL == obj_buffer)
+    {
+        return VA_STATUS_ERROR_INVALID_BUFFER;
+    }
+    if (0 == obj_buffer->export_count)
+    {
+        return VA_STATUS_ERROR_INVALID_BUFFER;
+    }
+
+    obj_buffer->export_count--;
+    return VA_STATUS_SUCCESS;
 }
+#endif
 
     
 
@@ -1293,9 +2677,31 @@ VAStatus rockchip_Terminate( VADriverContextP ctx )
 {
     INIT_DRIVER_DATA
     object_buffer_p obj_buffer;
+    object_surface_p obj_surface;
+    object_image_p obj_image;
+    object_context_p obj_context;
     object_config_p obj_config;
     object_heap_iterator iter;
 
+    /* Clean up left over contexts first, their workers still use surfaces */
+    obj_context = (object_context_p) object_heap_first( &driver_data->context_heap, &iter);
+    while (obj_context)
+    {
+        rockchip__information_message("vaTerminate: contextID %08x still allocated, destroying\n", obj_context->base.id);
+        rockchip__destroy_context(driver_data, obj_context);
+        obj_context = (object_context_p) object_heap_next( &driver_data->context_heap, &iter);
+    }
+
+    /* Clean up left over images, they own buffers and pin surfaces */
+    obj_image = (object_image_p) object_heap_first( &driver_data->image_heap, &iter);
+    while (obj_image)
+    {
+        rockchip__information_message("vaTerminate: imageID %08x still allocated, destroying\n", obj_image->base.id);
+        rockchip__destroy_image(driver_data, obj_image);
+        obj_image = (object_image_p) object_heap_next( &driver_data->image_heap, &iter);
+    }
+    object_heap_destroy( &driver_data->image_heap );
+
     /* Clean up left over buffers */
     obj_buffer = (object_buffer_p) object_heap_first( &driver_data->buffer_heap, &iter);
     while (obj_buffer)
@@ -1306,11 +2712,28 @@ VAStatus rockchip_Terminate( VADriverContextP ctx )
     }
     object_heap_destroy( &driver_data->buffer_heap );
 
-    /* TODO cleanup */
+    /* Clean up left over surfaces */
+    obj_surface = (object_surface_p) object_heap_first( &driver_data->surface_heap, &iter);
+    while (obj_surface)
+    {
+        rockchip__information_message("vaTerminate: surfaceID %08x still allocated, destroying\n", obj_surface->base.id);
+        rockchip__destroy_surfaces(driver_data, &obj_surface, 1);
+        obj_surface = (object_surface_p) object_heap_next( &driver_data->surface_heap, &iter);
+    }
     object_heap_destroy( &driver_data->surface_heap );
 
-    /* TODO cleanup */
+    if (driver_data->debug)
+    {
+        rockchip__information_message("surface cache: %lu hits, %lu misses\n",
+                                      driver_data->surface_cache.hits, driver_data->surface_cache.misses);
+    }
+    surface_cache_destroy( &driver_data->surface_cache );
+    frame_arena_destroy( &driver_data->frame_arena );
+    copy_engine_destroy( &driver_data->copy_engine );
+
     object_heap_destroy( &driver_data->context_heap );
+    pthread_cond_destroy( &driver_data->decode_cond );
+    pthread_mutex_destroy( &driver_data->decode_mutex );
 
     /* Clean up configIDs */
     obj_config = (object_config_p) object_heap_first( &driver_data->config_heap, &iter);
@@ -1321,6 +2744,14 @@ VAStatus rockchip_Terminate( VADriverContextP ctx )
     }
     object_heap_destroy( &driver_data->config_heap );
 
+    if (driver_data->debug)
+    {
+        rockchip__information_message("buffer pool: %lu hits, %lu misses\n",
+                                      driver_data->buffer_pool.hits, driver_data->buffer_pool.misses);
+    }
+    buffer_pool_destroy( &driver_data->buffer_pool );
+    dma_memory_cache_destroy( &driver_data->dma_cache );
+
     free(ctx->pDriverData);
     ctx->pDriverData = NULL;
 
@@ -1332,6 +2763,16 @@ VAStatus VA_DRIVER_INIT_FUNC(  VADriverContextP ctx )
     struct VADriverVTable * const vtable = ctx->vtable;
     int result;
     struct rockchip_driver_data *driver_data;
+    const char *debug;
+    const char *pool_max;
+    const char *dma_max;
+    const char *cache_max;
+    const char *copy_threads;
+    const char *surface_layout;
+    const char *surface_heap;
+    const char *decode_rate;
+    const char *simd;
+    unsigned int features;
 
     ctx->version_major = VA_MAJOR_VERSION;
     ctx->version_minor = VA_MINOR_VERSION;
@@ -1386,25 +2827,97 @@ VAStatus VA_DRIVER_INIT_FUNC(  VADriverContextP ctx )
     vtable->vaLockSurface = rockchip_LockSurface;
     vtable->vaUnlockSurface = rockchip_UnlockSurface;
     vtable->vaBufferInfo = rockchip_BufferInfo;
+#if VA_CHECK_VERSION(0,36,0)
+    vtable->vaAcquireBufferHandle = rockchip_AcquireBufferHandle;
+    vtable->vaReleaseBufferHandle = rockchip_ReleaseBufferHandle;
+#endif
 
     driver_data = (struct rockchip_driver_data *) malloc( sizeof(*driver_data) );
     ctx->pDriverData = (void *) driver_data;
 
-    result = object_heap_init( &driver_data->config_heap, sizeof(struct object_config), CONFIG_ID_OFFSET );
+    /* Statistics go to stderr only on request */
+    debug = getenv("ROCKCHIP_VA_DEBUG");
+    driver_data->debug = debug ? atoi(debug) : 0;
+
+    result = object_heap_init( &driver_data->config_heap, sizeof(struct object_config), CONFIG_ID_OFFSET, 0 );
+    ASSERT( result == 0 );
+
+    result = object_heap_init( &driver_data->context_heap, sizeof(struct object_context), CONTEXT_ID_OFFSET, OBJECT_HEAP_CACHE_ALIGNED );
+    ASSERT( result == 0 );
+
+    result = object_heap_init( &driver_data->surface_heap, sizeof(struct object_surface), SURFACE_ID_OFFSET, OBJECT_HEAP_FLAT | OBJECT_HEAP_CACHE_ALIGNED );
+    ASSERT( result == 0 );
+
+    result = object_heap_init( &driver_data->buffer_heap, sizeof(struct object_buffer), BUFFER_ID_OFFSET, OBJECT_HEAP_FLAT | OBJECT_HEAP_CACHE_ALIGNED );
+    ASSERT( result == 0 );
+
+    result = object_heap_init( &driver_data->image_heap, sizeof(struct object_image), IMAGE_ID_OFFSET, 0 );
+    ASSERT( result == 0 );
+
+    result = pthread_mutex_init( &driver_data->decode_mutex, NULL );
     ASSERT( result == 0 );
 
-    result = object_heap_init( &driver_data->context_heap, sizeof(struct object_context), CONTEXT_ID_OFFSET );
+    result = pthread_cond_init( &driver_data->decode_cond, NULL );
     ASSERT( result == 0 );
 
-    result = object_heap_init( &driver_data->surface_heap, sizeof(struct object_surface), SURFACE_ID_OFFSET );
+    pool_max = getenv("ROCKCHIP_VA_BUFFER_POOL_MAX");
+    result = buffer_pool_init( &driver_data->buffer_pool,
+                               pool_max ? strtoul(pool_max, NULL, 0) : ROCKCHIP_BUFFER_POOL_MAX_BYTES );
     ASSERT( result == 0 );
 
-    result = object_heap_init( &driver_data->buffer_heap, sizeof(struct object_buffer), BUFFER_ID_OFFSET );
+    dma_max = getenv("ROCKCHIP_VA_DMA_CACHE_MAX");
+    result = dma_memory_cache_init( &driver_data->dma_cache,
+                                    dma_max ? strtoul(dma_max, NULL, 0) : ROCKCHIP_DMA_CACHE_MAX_BYTES );
     ASSERT( result == 0 );
 
-    result = object_heap_init( &driver_data->image_heap, sizeof(struct object_image), IMAGE_ID_OFFSET );
+    /* Surface memory from a dma-buf heap, e.g. system-uncached, instead of anonymous memory */
+    surface_heap = getenv("ROCKCHIP_VA_SURFACE_HEAP");
+    result = frame_arena_init( &driver_data->frame_arena, surface_heap );
     ASSERT( result == 0 );
+    if (surface_heap && driver_data->frame_arena.heap_fd < 0)
+    {
+        rockchip__error_message("ROCKCHIP_VA_SURFACE_HEAP: no dma-buf heap %s\n", surface_heap);
+    }
+
+    copy_threads = getenv("ROCKCHIP_VA_COPY_THREADS");
+    result = copy_engine_init( &driver_data->copy_engine,
+                               copy_threads ? atoi(copy_threads) :
+                               MIN(sysconf(_SC_NPROCESSORS_ONLN), ROCKCHIP_COPY_THREADS) );
+    ASSERT( result == 0 );
+
+    cache_max = getenv("ROCKCHIP_VA_SURFACE_CACHE_MAX");
+    result = surface_cache_init( &driver_data->surface_cache, &driver_data->frame_arena,
+                                 cache_max ? strtoul(cache_max, NULL, 0) : ROCKCHIP_SURFACE_CACHE_MAX_BYTES );
+    ASSERT( result == 0 );
+
+    /* Decoder output layout: linear (default), tile4x4 or tile16x16 */
+    surface_layout = getenv("ROCKCHIP_VA_SURFACE_LAYOUT");
+    driver_data->surface_layout = ROCKCHIP_SURFACE_LAYOUT_LINEAR;
+    if (surface_layout && 0 == strcmp(surface_layout, "tile4x4"))
+    {
+        driver_data->surface_layout = ROCKCHIP_SURFACE_LAYOUT_TILE4X4;
+    }
+    else if (surface_layout && 0 == strcmp(surface_layout, "tile16x16"))
+    {
+        driver_data->surface_layout = ROCKCHIP_SURFACE_LAYOUT_TILE16X16;
+    }
+
+    /* Simulated decoder throughput in MB/s, for latency measurements without hardware */
+    decode_rate = getenv("ROCKCHIP_VA_DECODE_RATE");
+    driver_data->decode_rate = decode_rate ? strtoul(decode_rate, NULL, 0) : 0;
 
+    /* Pixel kernels for this CPU, ROCKCHIP_VA_SIMD caps the level for A/B runs */
+    features = cpu_features_probe();
+    simd = getenv("ROCKCHIP_VA_SIMD");
+    if (simd && cpu_features_limit(&features, simd))
+    {
+        rockchip__error_message("ROCKCHIP_VA_SIMD: unknown level %s\n", simd);
+    }
+    image_convert_init(features);
+    if (driver_data->debug)
+    {
+        rockchip__information_message("pixel kernels: %s\n", cpu_features_name(features));
+    }
 
     return VA_STATUS_SUCCESS;
 }
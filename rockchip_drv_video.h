@@ -25,23 +25,76 @@
 #ifndef _ROCKCHIP_DRV_VIDEO_H_
 #define _ROCKCHIP_DRV_VIDEO_H_
 
+#include <stdint.h>
 #include <va/va.h>
 #include "object_heap.h"
+#include "buffer_pool.h"
+#include "bitstream_arena.h"
+#include "dma_memory.h"
+#include "frame_arena.h"
+#include "surface_cache.h"
+#include "copy_engine.h"
+#include "decode_worker.h"
 
 #define ROCKCHIP_MAX_PROFILES			11
 #define ROCKCHIP_MAX_ENTRYPOINTS		5
 #define ROCKCHIP_MAX_CONFIG_ATTRIBUTES		10
-#define ROCKCHIP_MAX_IMAGE_FORMATS		1
+#define ROCKCHIP_MAX_IMAGE_FORMATS		8
 #define ROCKCHIP_MAX_SUBPIC_FORMATS		4
 #define ROCKCHIP_MAX_DISPLAY_ATTRIBUTES		4
 #define ROCKCHIP_STR_VENDOR			"Rockchip Driver 1.0"
 
+/* Bytes of released buffer memory kept for reuse, see ROCKCHIP_VA_BUFFER_POOL_MAX */
+#define ROCKCHIP_BUFFER_POOL_MAX_BYTES		(16 * 1024 * 1024)
+
+/* Bytes of released dma-buf memory kept for reuse, see ROCKCHIP_VA_DMA_CACHE_MAX */
+#define ROCKCHIP_DMA_CACHE_MAX_BYTES		(32 * 1024 * 1024)
+
+/* Frames of destroyed surfaces kept for reuse, overridden by ROCKCHIP_VA_SURFACE_CACHE_MAX */
+#define ROCKCHIP_SURFACE_CACHE_MAX_BYTES	(256 * 1024 * 1024)
+
+/* Default copy engine threads, overridden by ROCKCHIP_VA_COPY_THREADS */
+#define ROCKCHIP_COPY_THREADS			4
+
+/*
+ * Private config attribute: pictures a context keeps in flight, 1 to
+ * DECODE_WORKER_MAX_DEPTH. vaGetConfigAttributes reports the maximum.
+ */
+#define ROCKCHIP_CONFIG_ATTRIB_DECODE_DEPTH	((VAConfigAttribType) 0x10000)
+
+/*
+ * Private config attribute: 1 streams each picture's slices to the
+ * decoder as vaRenderPicture receives them, one picture at a time and
+ * without any queueing. vaGetConfigAttributes reports 1 if supported.
+ */
+#define ROCKCHIP_CONFIG_ATTRIB_LOW_LATENCY	((VAConfigAttribType) 0x10001)
+
+/* Pictures in flight per context unless the config sets the depth */
+#define ROCKCHIP_DECODE_DEPTH			4
+
+/* Packed 10 bit 4:2:0, four samples in five bytes, as the decoders emit it */
+#define ROCKCHIP_FOURCC_NV15			VA_FOURCC('N', 'V', '1', '5')
+
+/* Surface plane pitch and height alignment */
+#define ROCKCHIP_SURFACE_PITCH_ALIGN		64
+#define ROCKCHIP_SURFACE_HEIGHT_ALIGN		16
+
 struct rockchip_driver_data {
     struct object_heap	config_heap;
     struct object_heap	context_heap;
     struct object_heap	surface_heap;
     struct object_heap	buffer_heap;
     struct object_heap	image_heap;
+    struct buffer_pool	buffer_pool;
+    struct dma_memory_cache	dma_cache;
+    struct frame_arena	frame_arena;
+    struct surface_cache	surface_cache;
+    struct copy_engine	copy_engine;
+    int surface_layout;	/* decoder output layout, see ROCKCHIP_VA_SURFACE_LAYOUT */
+    unsigned int decode_rate;	/* simulated decoder MB/s, 0 for none, see ROCKCHIP_VA_DECODE_RATE */
+    int debug;		/* print statistics, see ROCKCHIP_VA_DEBUG */
+    pthread_mutex_t decode_mutex;	/* guards surface pending counts */
+    pthread_cond_t decode_cond;	/* a picture was decoded */
 };
 
 struct object_config {
@@ -52,31 +105,106 @@ struct object_config {
     int attrib_count;
 };
 
+/*
+ * Objects of the context, surface and buffer heaps each own a cache line
+ * (OBJECT_HEAP_CACHE_ALIGNED). Fields touched on every frame come first so
+ * they share the line with the heap's id/next_free; configuration set at
+ * creation time follows.
+ */
 struct object_context {
     struct object_base base;
+    /* Per frame */
+    VASurfaceID current_render_target;
+    struct rockchip_picture *picture;	/* slot being filled, NULL outside Begin/EndPicture */
+    /* Set at creation */
     VAContextID context_id;
     VAConfigID config_id;
-    VASurfaceID current_render_target;
     int picture_width;
     int picture_height;
     int num_render_targets;
     int flags;
     VASurfaceID *render_targets;
+    struct rockchip_picture *pictures;	/* the worker's ring slots */
+    int low_latency;	/* see ROCKCHIP_CONFIG_ATTRIB_LOW_LATENCY */
+    struct decode_worker worker;
+    /* Latency statistics, kept by the worker */
+    unsigned long decoded;
+    uint64_t latency_sum;	/* ns from vaBeginPicture to a ready frame */
+    uint64_t latency_max;
+    uint64_t tail_sum;		/* ns from vaEndPicture to a ready frame */
+};
+
+/*
+ * A ring slot of a context, from vaBeginPicture until the worker has
+ * decoded it. Each slot keeps its bitstream storage across pictures.
+ * In low latency mode the worker has the slot from vaBeginPicture on,
+ * the bitstream and the slice counts are then shared under the
+ * worker's lock.
+ */
+struct rockchip_picture {
+    struct rockchip_driver_data *driver_data;
+    struct object_surface *surface;
+    int layout;		/* ROCKCHIP_SURFACE_LAYOUT_* the frame comes out in, -1 to keep */
+    struct bitstream_arena bitstream;	/* slice data of the picture */
+    int num_slices_ready;	/* low latency: slices the decoder may take */
+    int num_slices_sent;	/* low latency: slices the decoder has */
+    int complete;	/* low latency: vaEndPicture was called */
+    uint64_t begin_time;	/* CLOCK_MONOTONIC ns */
+    uint64_t end_time;
+};
+
+/*
+ * Arrangement of a surface frame as its producer last wrote it. Tiled
+ * frames store each plane as blocks of tile width bytes by tile height
+ * lines, see image_convert_detile_plane(). Chroma blocks cover half the
+ * lines of their luma blocks.
+ */
+enum {
+    ROCKCHIP_SURFACE_LAYOUT_LINEAR,
+    ROCKCHIP_SURFACE_LAYOUT_TILE4X4,	/* 4x4 luma, 4x2 chroma bytes */
+    ROCKCHIP_SURFACE_LAYOUT_TILE16X16,	/* 16x16 luma, 16x8 chroma bytes */
 };
 
 struct object_surface {
     struct object_base base;
+    /* Per frame */
+    int pending;	/* pictures queued for it, under decode_mutex */
+    int streaming;	/* low latency pictures begun but not ended, under decode_mutex */
+    /* Set at creation */
     VASurfaceID surface_id;
     int orig_width;
     int orig_height;
+    int format;		/* VA_RT_FORMAT_* */
     int fourcc;
+    unsigned char *data;	/* frame_arena memory */
+    int caching;	/* DMA_MEMORY_* mapping of data */
+    int layout;		/* ROCKCHIP_SURFACE_LAYOUT_* of data */
+    unsigned int size;
+    unsigned int num_planes;
+    unsigned int pitches[3];
+    unsigned int offsets[3];
+    VAImageID derived_image;	/* VA_INVALID_ID unless vaDeriveImage'd */
+};
+
+enum {
+    ROCKCHIP_BUFFER_MEM_POOL,	/* buffer_pool block */
+    ROCKCHIP_BUFFER_MEM_DMA,	/* dma_memory, shareable with devices */
+    ROCKCHIP_BUFFER_MEM_SURFACE,	/* aliases a surface frame, not owned */
 };
 
 struct object_buffer {
     struct object_base base;
+    /* Per frame */
     void *buffer_data;
-    int max_num_elements;
     int num_elements;
+    /* Set at creation */
+    VABufferType type;
+    unsigned int size;
+    int max_num_elements;
+    int mem_type;
+    struct dma_memory dma;
+    int export_count;	/* outstanding vaAcquireBufferHandle calls */
+    int exported;	/* memory was handed out, never recycle it */
 };
 
 struct object_image {
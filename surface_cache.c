@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2015 - 2016 Rockchip Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <stdlib.h>
+#include "surface_cache.h"
+
+#define SURFACE_CACHE_BATCH 64
+
+static void
+surface_cache_unlink(surface_cache_p cache, surface_cache_entry_p entry)
+{
+    if (entry->prev)
+        entry->prev->next = entry->next;
+    else
+        cache->head = entry->next;
+    if (entry->next)
+        entry->next->prev = entry->prev;
+    else
+        cache->tail = entry->prev;
+    cache->cached_bytes -= entry->size;
+}
+
+/*
+ * Returns a list of entries to the arena, one arena round trip per run
+ * of equally sized frames. Called without the cache lock held.
+ */
+static void
+surface_cache_release(surface_cache_p cache, surface_cache_entry_p list)
+{
+    void *batch[SURFACE_CACHE_BATCH];
+    surface_cache_entry_p next;
+    size_t size = 0;
+    int n = 0;
+
+    for (; list; list = next) {
+        next = list->next;
+        if (n && (n == SURFACE_CACHE_BATCH || list->size != size)) {
+            frame_arena_free_n(cache->arena, size, n, batch);
+            n = 0;
+        }
+        size = list->size;
+        batch[n++] = list->data;
+        free(list);
+    }
+    if (n)
+        frame_arena_free_n(cache->arena, size, n, batch);
+}
+
+/*
+ * Detaches least recently used entries until the cache fits max_bytes
+ * and returns them as a list linked through next.
+ */
+static surface_cache_entry_p
+surface_cache_evict_unlocked(surface_cache_p cache, size_t max_bytes)
+{
+    surface_cache_entry_p list = NULL;
+    surface_cache_entry_p entry;
+
+    while (cache->cached_bytes > max_bytes) {
+        entry = cache->tail;
+        surface_cache_unlink(cache, entry);
+        entry->next = list;
+        list = entry;
+    }
+    return list;
+}
+
+/*
+ * Return 0 on success, -1 on error
+ */
+int
+surface_cache_init(surface_cache_p cache, frame_arena_p arena, size_t max_bytes)
+{
+    if (pthread_mutex_init(&cache->mutex, NULL))
+        return -1;
+    cache->arena = arena;
+    cache->max_bytes = max_bytes;
+    cache->cached_bytes = 0;
+    cache->head = NULL;
+    cache->tail = NULL;
+    cache->hits = 0;
+    cache->misses = 0;
+    return 0;
+}
+
+int
+surface_cache_alloc_n(surface_cache_p cache, int width, int height, int format,
+                      size_t size, int n, void **frames)
+{
+    surface_cache_entry_p taken = NULL;
+    surface_cache_entry_p entry, next;
+    int i = 0;
+
+    pthread_mutex_lock(&cache->mutex);
+    for (entry = cache->head; entry && i < n; entry = next) {
+        next = entry->next;
+        if (entry->width == width && entry->height == height &&
+            entry->format == format && entry->size == size) {
+            surface_cache_unlink(cache, entry);
+            frames[i++] = entry->data;
+            entry->next = taken;
+            taken = entry;
+        }
+    }
+    cache->hits += i;
+    cache->misses += n - i;
+    pthread_mutex_unlock(&cache->mutex);
+
+    for (; taken; taken = next) {
+        next = taken->next;
+        free(taken);
+    }
+
+    if (i == n || 0 == frame_arena_alloc_n(cache->arena, size, n - i, frames + i))
+        return 0;
+
+    /* Out of address space, flush frames of other sizes and retry once */
+    pthread_mutex_lock(&cache->mutex);
+    entry = surface_cache_evict_unlocked(cache, 0);
+    pthread_mutex_unlock(&cache->mutex);
+    surface_cache_release(cache, entry);
+
+    if (0 == frame_arena_alloc_n(cache->arena, size, n - i, frames + i))
+        return 0;
+
+    frame_arena_free_n(cache->arena, size, i, frames);
+    return -1;
+}
+
+void
+surface_cache_free_n(surface_cache_p cache, int width, int height, int format,
+                     size_t size, int n, void **frames)
+{
+    surface_cache_entry_p evicted;
+    surface_cache_entry_p entry;
+    int i;
+
+    pthread_mutex_lock(&cache->mutex);
+    for (i = 0; i < n; i++) {
+        if (NULL == frames[i])
+            continue;
+        if (size > cache->max_bytes || NULL == (entry = malloc(sizeof(*entry))))
+            break;
+        entry->width = width;
+        entry->height = height;
+        entry->format = format;
+        entry->size = size;
+        entry->data = frames[i];
+        entry->prev = NULL;
+        entry->next = cache->head;
+        if (cache->head)
+            cache->head->prev = entry;
+        else
+            cache->tail = entry;
+        cache->head = entry;
+        cache->cached_bytes += size;
+        frames[i] = NULL;
+    }
+    evicted = surface_cache_evict_unlocked(cache, cache->max_bytes);
+    pthread_mutex_unlock(&cache->mutex);
+
+    surface_cache_release(cache, evicted);
+    /* Whatever could not be cached */
+    if (i < n)
+        frame_arena_free_n(cache->arena, size, n - i, frames + i);
+}
+
+void
+surface_cache_destroy(surface_cache_p cache)
+{
+    surface_cache_release(cache, surface_cache_evict_unlocked(cache, 0));
+    pthread_mutex_destroy(&cache->mutex);
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2015 - 2016 Rockchip Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef SURFACE_CACHE_H
+#define SURFACE_CACHE_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include "frame_arena.h"
+
+typedef struct surface_cache *surface_cache_p;
+typedef struct surface_cache_entry *surface_cache_entry_p;
+
+/* Frame memory of a destroyed surface */
+struct surface_cache_entry {
+    int width;
+    int height;
+    int format;
+    size_t size;
+    void *data;
+    surface_cache_entry_p prev;     /* towards most recently used */
+    surface_cache_entry_p next;     /* towards least recently used */
+};
+
+/*
+ * Keeps the frames of destroyed surfaces, still faulted in, for the next
+ * CreateSurfaces of the same width, height and RT format. Players tear
+ * down and rebuild the whole set on every seek. Least recently released
+ * frames go back to the arena once max_bytes is exceeded.
+ */
+struct surface_cache {
+    pthread_mutex_t mutex;
+    frame_arena_p arena;
+    size_t max_bytes;
+    size_t cached_bytes;
+    surface_cache_entry_p head;
+    surface_cache_entry_p tail;
+    unsigned long hits;
+    unsigned long misses;
+};
+
+/*
+ * Return 0 on success, -1 on error
+ */
+int
+surface_cache_init(surface_cache_p cache, frame_arena_p arena, size_t max_bytes);
+
+/*
+ * Returns n frames of size bytes each, cached ones for the same width,
+ * height and format first and the rest from the arena, all or nothing.
+ * Return 0 on success, -1 on error
+ */
+int
+surface_cache_alloc_n(surface_cache_p cache, int width, int height, int format,
+                      size_t size, int n, void **frames);
+
+/*
+ * Releases n frames obtained with the same parameters into the cache.
+ */
+void
+surface_cache_free_n(surface_cache_p cache, int width, int height, int format,
+                     size_t size, int n, void **frames);
+
+/*
+ * Returns all cached frames to the arena.
+ */
+void
+surface_cache_destroy(surface_cache_p cache);
+
+#endif /* SURFACE_CACHE_H */
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2015 - 2016 Rockchip Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The slice data of a picture must stay in place while slices are
+ * appended, a low latency decoder reads the earlier ones meanwhile.
+ * Slices of random size are appended well past the first chunk and
+ * every slice appended so far is checked after each append. A reset
+ * then has to merge the chunks, so the same picture fits into one.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitstream_arena.h"
+
+#define NUM_SLICES      200
+#define MAX_SLICE_BYTES (8 * 1024)
+
+static const unsigned char *where[NUM_SLICES];
+static unsigned int sizes[NUM_SLICES];
+
+static unsigned char
+pattern(int slice, unsigned int i)
+{
+    return (unsigned char) (slice * 31 + i * 7 + 1);
+}
+
+/*
+ * Appends the picture, checking the slices before each new one.
+ * Returns 0 if all stayed put
+ */
+static int
+append_picture(bitstream_arena_p arena)
+{
+    static unsigned char data[MAX_SLICE_BYTES];
+    const unsigned char *p;
+    unsigned int i;
+    int slice, n;
+
+    for (slice = 0; slice < NUM_SLICES; slice++) {
+        for (i = 0; i < sizes[slice]; i++)
+            data[i] = pattern(slice, i);
+        if (bitstream_arena_append(arena, data, sizes[slice])) {
+            fprintf(stderr, "slice %d: append failed\n", slice);
+            return -1;
+        }
+        where[slice] = bitstream_arena_slice_data(arena, slice);
+
+        for (n = 0; n <= slice; n++) {
+            p = bitstream_arena_slice_data(arena, n);
+            if (p != where[n]) {
+                fprintf(stderr, "slice %d moved when slice %d was appended\n", n, slice);
+                return -1;
+            }
+            for (i = 0; i < sizes[n]; i++) {
+                if (p[i] != pattern(n, i)) {
+                    fprintf(stderr, "slice %d: byte %u changed when slice %d was appended\n", n, i, slice);
+                    return -1;
+                }
+            }
+        }
+        for (i = 0; i < BITSTREAM_ARENA_PADDING; i++) {
+            if (p[sizes[slice] + i]) {
+                fprintf(stderr, "slice %d: padding byte %u not zero\n", slice, i);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int
+main(void)
+{
+    struct bitstream_arena arena;
+    size_t total = 0;
+    int failed = 0;
+    int slice;
+
+    srand(1);
+    for (slice = 0; slice < NUM_SLICES; slice++) {
+        sizes[slice] = rand() % MAX_SLICE_BYTES;
+        total += sizes[slice];
+    }
+
+    bitstream_arena_init(&arena, NULL);
+    if (append_picture(&arena) || arena.size != total)
+        failed = 1;
+    if (arena.num_chunks < 2) {
+        fprintf(stderr, "%zu bytes fit into %d chunk\n", total, arena.num_chunks);
+        failed = 1;
+    }
+
+    bitstream_arena_reset(&arena);
+    if (append_picture(&arena))
+        failed = 1;
+    if (arena.num_chunks != 1) {
+        fprintf(stderr, "after reset: %zu bytes took %d chunks\n", total, arena.num_chunks);
+        failed = 1;
+    }
+
+    bitstream_arena_destroy(&arena);
+    return failed;
+}
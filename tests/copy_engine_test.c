@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2015 - 2016 Rockchip Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Checks that concurrent copy_engine_run calls each see every row of
+ * their transfer exactly once, then reports how a 4K NV12 frame copy
+ * scales from 1 to COPY_ENGINE_MAX_THREADS / 2 threads, with one caller
+ * and with two callers copying at the same time.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "copy_engine.h"
+
+#define FRAME_WIDTH     3840
+#define FRAME_ROWS      (2160 * 3 / 2)
+#define MAX_CALLERS     4
+#define CHECK_ROUNDS    200
+#define BENCH_SECONDS   0.2
+
+struct row_count {
+    unsigned int rows;
+    int *count;
+};
+
+struct frame_copy {
+    unsigned char *dst;
+    const unsigned char *src;
+};
+
+struct caller {
+    copy_engine_p engine;
+    unsigned int rows;
+    unsigned long frames;
+    double seconds;
+    int failed;
+};
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+count_rows(void *arg, unsigned int first_row, unsigned int num_rows)
+{
+    struct row_count *job = arg;
+    unsigned int i;
+
+    for (i = first_row; i < first_row + num_rows; i++)
+        __atomic_add_fetch(&job->count[i], 1, __ATOMIC_RELAXED);
+}
+
+static void
+copy_rows(void *arg, unsigned int first_row, unsigned int num_rows)
+{
+    struct frame_copy *job = arg;
+    size_t offset = (size_t) first_row * FRAME_WIDTH;
+
+    memcpy(job->dst + offset, job->src + offset, (size_t) num_rows * FRAME_WIDTH);
+}
+
+/* Runs transfers of varying height, every row must be visited once */
+static void *
+check_caller(void *data)
+{
+    struct caller *caller = data;
+    struct row_count job;
+    unsigned int round, i;
+
+    job.count = malloc(FRAME_ROWS * sizeof(int));
+    if (!job.count) {
+        caller->failed = 1;
+        return NULL;
+    }
+    for (round = 0; round < CHECK_ROUNDS && !caller->failed; round++) {
+        job.rows = caller->rows - round * 7 % 1000;
+        memset(job.count, 0, FRAME_ROWS * sizeof(int));
+        copy_engine_run(caller->engine, count_rows, &job, job.rows, FRAME_WIDTH);
+        for (i = 0; i < FRAME_ROWS; i++) {
+            if (job.count[i] != (i < job.rows)) {
+                fprintf(stderr, "%u of %u rows: row %u visited %d times\n",
+                        job.rows, FRAME_ROWS, i, job.count[i]);
+                caller->failed = 1;
+                break;
+            }
+        }
+    }
+    free(job.count);
+    return NULL;
+}
+
+/* Copies frames for BENCH_SECONDS */
+static void *
+bench_caller(void *data)
+{
+    struct caller *caller = data;
+    struct frame_copy job;
+    double start;
+
+    job.src = malloc((size_t) FRAME_ROWS * FRAME_WIDTH);
+    job.dst = malloc((size_t) FRAME_ROWS * FRAME_WIDTH);
+    if (!job.src || !job.dst) {
+        caller->failed = 1;
+    } else {
+        memset((unsigned char *) job.src, 0x5a, (size_t) FRAME_ROWS * FRAME_WIDTH);
+        memset(job.dst, 0, (size_t) FRAME_ROWS * FRAME_WIDTH);
+        start = now();
+        caller->frames = 0;
+        do {
+            copy_engine_run(caller->engine, copy_rows, &job, FRAME_ROWS, FRAME_WIDTH);
+            caller->frames++;
+        } while ((caller->seconds = now() - start) < BENCH_SECONDS);
+        if (memcmp(job.dst, job.src, (size_t) FRAME_ROWS * FRAME_WIDTH))
+            caller->failed = 1;
+    }
+    free((unsigned char *) job.src);
+    free(job.dst);
+    return NULL;
+}
+
+/*
+ * Runs func on num_callers threads sharing engine.
+ * Returns the frames per second all callers achieved together, or -1 if
+ * any failed
+ */
+static double
+run_callers(copy_engine_p engine, void *(*func)(void *), int num_callers)
+{
+    struct caller callers[MAX_CALLERS];
+    pthread_t threads[MAX_CALLERS];
+    double rate = 0;
+    int failed = 0;
+    int i;
+
+    for (i = 0; i < num_callers; i++) {
+        callers[i].engine = engine;
+        callers[i].rows = FRAME_ROWS - i;
+        callers[i].frames = 0;
+        callers[i].seconds = 0;
+        callers[i].failed = 0;
+        pthread_create(&threads[i], NULL, func, &callers[i]);
+    }
+    for (i = 0; i < num_callers; i++) {
+        pthread_join(threads[i], NULL);
+        failed |= callers[i].failed;
+        if (callers[i].seconds > 0)
+            rate += callers[i].frames / callers[i].seconds;
+    }
+    return failed ? -1 : rate;
+}
+
+int
+main(void)
+{
+    struct copy_engine engine;
+    double frame_bytes = (double) FRAME_ROWS * FRAME_WIDTH;
+    int failed = 0;
+    int threads;
+
+    if (copy_engine_init(&engine, 4))
+        return 1;
+    if (run_callers(&engine, check_caller, 1) < 0 ||
+        run_callers(&engine, check_caller, MAX_CALLERS) < 0)
+        failed = 1;
+    copy_engine_destroy(&engine);
+
+    for (threads = 1; threads <= COPY_ENGINE_MAX_THREADS / 2; threads *= 2) {
+        double one, two;
+
+        if (copy_engine_init(&engine, threads))
+            return 1;
+        one = run_callers(&engine, bench_caller, 1);
+        two = run_callers(&engine, bench_caller, 2);
+        copy_engine_destroy(&engine);
+        if (one < 0 || two < 0) {
+            failed = 1;
+            break;
+        }
+        printf("%d thread%s: 1 caller %6.2f GB/s, 2 callers %6.2f GB/s\n",
+               threads, threads > 1 ? "s" : " ",
+               one * frame_bytes / 1e9, two * frame_bytes / 1e9);
+    }
+    return failed;
+}
@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2015 - 2016 Rockchip Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Frames carved from the arena must be page aligned, disjoint and keep
+ * their contents. A DPB of 1080p frames has to come out of few huge
+ * page aligned chunks, and freed frames in any order must merge back so
+ * that a later set of a different size fits into the same chunks.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "frame_arena.h"
+
+#define NUM_FRAMES      17
+#define FRAME_SIZE      (1920 * 1088 * 3 / 2)
+#define BIG_FRAME_SIZE  (3840 * 2176 * 3 / 2)
+
+static int failed;
+
+static int
+count_chunks(const struct frame_arena *arena)
+{
+    frame_chunk_p chunk;
+    int n = 0;
+
+    for (chunk = arena->chunks; chunk; chunk = chunk->next) {
+        if ((uintptr_t) chunk->base % FRAME_ARENA_HUGE_PAGE) {
+            fprintf(stderr, "chunk at %p not huge page aligned\n", (void *) chunk->base);
+            failed = 1;
+        }
+        n++;
+    }
+    return n;
+}
+
+/* Fills each frame with its index, checked by check_frames() */
+static void
+fill_frames(void **frames, int n, size_t size)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        memset(frames[i], i + 1, size);
+}
+
+static void
+check_frames(void **frames, int n, size_t size)
+{
+    const unsigned char *p;
+    size_t j;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (!frames[i])
+            continue;
+        if ((uintptr_t) frames[i] % FRAME_ARENA_ALIGNMENT) {
+            fprintf(stderr, "frame %d at %p not page aligned\n", i, frames[i]);
+            failed = 1;
+        }
+        p = frames[i];
+        for (j = 0; j < size; j++) {
+            if (p[j] != i + 1) {
+                fprintf(stderr, "frame %d: byte %zu overwritten\n", i, j);
+                failed = 1;
+                break;
+            }
+        }
+    }
+}
+
+int
+main(void)
+{
+    struct frame_arena arena;
+    void *frames[NUM_FRAMES];
+    void *big[NUM_FRAMES / 4];
+    int chunks, i, j;
+
+    if (frame_arena_init(&arena, NULL))
+        return 1;
+
+    if (frame_arena_alloc_n(&arena, FRAME_SIZE, NUM_FRAMES, frames)) {
+        fprintf(stderr, "%d frames of %d bytes failed\n", NUM_FRAMES, FRAME_SIZE);
+        return 1;
+    }
+    fill_frames(frames, NUM_FRAMES, FRAME_SIZE);
+    check_frames(frames, NUM_FRAMES, FRAME_SIZE);
+
+    /* 17 frames of 3 MB need two 32 MB chunks */
+    chunks = count_chunks(&arena);
+    if (chunks > ((size_t) NUM_FRAMES * FRAME_SIZE + FRAME_ARENA_CHUNK_SIZE - 1) / FRAME_ARENA_CHUNK_SIZE) {
+        fprintf(stderr, "%d frames took %d chunks\n", NUM_FRAMES, chunks);
+        failed = 1;
+    }
+
+    /* Every other frame back, then the rest from the end, the others must not notice */
+    for (i = 0; i < NUM_FRAMES; i += 2) {
+        frame_arena_free_n(&arena, FRAME_SIZE, 1, &frames[i]);
+        frames[i] = NULL;
+    }
+    check_frames(frames, NUM_FRAMES, FRAME_SIZE);
+    for (i = NUM_FRAMES - 1; i >= 0; i--) {
+        if (frames[i])
+            frame_arena_free_n(&arena, FRAME_SIZE, 1, &frames[i]);
+        frames[i] = NULL;
+    }
+
+    /* With the free ranges merged 4K frames fit into the same chunks */
+    if (frame_arena_alloc_n(&arena, BIG_FRAME_SIZE, NUM_FRAMES / 4, big)) {
+        fprintf(stderr, "%d frames of %d bytes failed\n", NUM_FRAMES / 4, BIG_FRAME_SIZE);
+        return 1;
+    }
+    fill_frames(big, NUM_FRAMES / 4, BIG_FRAME_SIZE);
+    check_frames(big, NUM_FRAMES / 4, BIG_FRAME_SIZE);
+    if (count_chunks(&arena) != chunks) {
+        fprintf(stderr, "4K frames took %d chunks instead of %d\n", count_chunks(&arena), chunks);
+        failed = 1;
+    }
+    for (i = 0; i < NUM_FRAMES / 4; i++) {
+        for (j = 0; j < NUM_FRAMES / 4; j++) {
+            if (i != j && (unsigned char *) big[i] < (unsigned char *) big[j] + BIG_FRAME_SIZE &&
+                (unsigned char *) big[j] < (unsigned char *) big[i] + BIG_FRAME_SIZE) {
+                fprintf(stderr, "frames %d and %d overlap\n", i, j);
+                failed = 1;
+            }
+        }
+    }
+
+    frame_arena_free_n(&arena, BIG_FRAME_SIZE, NUM_FRAMES / 4, big);
+    frame_arena_destroy(&arena);
+    return failed;
+}
@@ -0,0 +1,317 @@
+/*
+ * Copyright (c) 2015 - 2016 Rockchip Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Downscaling vaGetImage. An NV12 frame of odd size goes into a surface
+ * 1:1, then regions of it are read back smaller, 2:1 through the box
+ * filter and at other ratios through the bilinear one, into NV12, I420
+ * and YV12. Each plane must match image_convert_scale_plane() run on
+ * the uploaded frame, which image_convert_test checks against reference
+ * filters. Every read is done for linear and tiled surfaces, tiled ones
+ * must stay tiled throughout.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <va/va_backend.h>
+
+#include "config.h"
+#include "rockchip_drv_video.h"
+#include "image_convert.h"
+
+#define WIDTH   99
+#define HEIGHT  37
+
+VAStatus VA_DRIVER_INIT_FUNC(VADriverContextP ctx);
+
+static struct VADriverVTable vtable;
+static struct VADriverContext context;
+static int failed;
+
+#define CHECK(call)                                                     \
+    do {                                                                \
+        VAStatus status_ = (call);                                      \
+        if (VA_STATUS_SUCCESS != status_) {                             \
+            fprintf(stderr, "%s:%d: %s failed: 0x%x\n",                 \
+                    __FILE__, __LINE__, #call, status_);                \
+            exit(1);                                                    \
+        }                                                               \
+    } while (0)
+
+static VAImage
+create_image(VADriverContextP ctx, unsigned int fourcc, int width, int height, uint8_t **data)
+{
+    VAImageFormat format;
+    VAImage image;
+
+    memset(&format, 0, sizeof(format));
+    format.fourcc = fourcc;
+    format.byte_order = VA_LSB_FIRST;
+    format.bits_per_pixel = 12;
+    CHECK(vtable.vaCreateImage(ctx, &format, width, height, &image));
+    CHECK(vtable.vaMapBuffer(ctx, image.buf, (void **) data));
+    return image;
+}
+
+static void
+compare_plane(const char *what, const char *plane, const uint8_t *data, unsigned int pitch, unsigned int step,
+              const uint8_t *ref, unsigned int ref_pitch, unsigned int width, unsigned int height)
+{
+    unsigned int x, y;
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            if (data[y * pitch + x * step] != ref[y * ref_pitch + x]) {
+                fprintf(stderr, "%s: %s differs at %u,%u\n", what, plane, x, y);
+                failed = 1;
+                return;
+            }
+        }
+    }
+}
+
+/*
+ * Reads the rect at (x, y) of the surface into a width x height image
+ * and compares it with the same scale of src, the NV12 frame uploaded
+ */
+static void
+check_get_image(VADriverContextP ctx, VASurfaceID surface, const VAImage *src, const uint8_t *src_data,
+                unsigned int fourcc, int x, int y, int rect_width, int rect_height,
+                int width, int height)
+{
+    const uint8_t *src_y = src_data + src->offsets[0] + y * src->pitches[0] + x;
+    const uint8_t *src_uv = src_data + src->offsets[1] + y / 2 * src->pitches[1] + (x & ~1);
+    unsigned int chroma_width = (width + 1) / 2, chroma_height = (height + 1) / 2;
+    uint8_t ref[WIDTH * HEIGHT];
+    uint8_t *data, *u, *v;
+    unsigned int u_pitch, v_pitch, step;
+    char what[64];
+    VAImage image;
+    int i;
+
+    image = create_image(ctx, fourcc, width, height, &data);
+    CHECK(vtable.vaGetImage(ctx, surface, x, y, rect_width, rect_height, image.image_id));
+
+    switch (fourcc) {
+    case VA_FOURCC_NV12:
+        u = data + image.offsets[1];
+        v = u + 1;
+        u_pitch = v_pitch = image.pitches[1];
+        step = 2;
+        break;
+    case VA_FOURCC_YV12:
+        v = data + image.offsets[1];
+        u = data + image.offsets[2];
+        v_pitch = image.pitches[1];
+        u_pitch = image.pitches[2];
+        step = 1;
+        break;
+    default:
+        u = data + image.offsets[1];
+        v = data + image.offsets[2];
+        u_pitch = image.pitches[1];
+        v_pitch = image.pitches[2];
+        step = 1;
+        break;
+    }
+
+    snprintf(what, sizeof(what), "%.4s %dx%d at %d,%d to %dx%d",
+             (const char *) &fourcc, rect_width, rect_height, x, y, width, height);
+    image_convert_scale_plane(ref, WIDTH, 1, src_y, src->pitches[0], 1,
+                              rect_width, rect_height, width, height, 0, height);
+    compare_plane(what, "Y", data + image.offsets[0], image.pitches[0], 1, ref, WIDTH, width, height);
+
+    for (i = 0; i < 2; i++) {
+        image_convert_scale_plane(ref, WIDTH, 1, src_uv + i, src->pitches[1], 2,
+                                  (rect_width + 1) / 2, (rect_height + 1) / 2,
+                                  chroma_width, chroma_height, 0, chroma_height);
+        compare_plane(what, i ? "V" : "U", i ? v : u, i ? v_pitch : u_pitch, step, ref, WIDTH,
+                      chroma_width, chroma_height);
+    }
+
+    CHECK(vtable.vaUnmapBuffer(ctx, image.buf));
+    CHECK(vtable.vaDestroyImage(ctx, image.image_id));
+}
+
+/*
+ * A derived image is the surface frame itself: it shows the uploaded
+ * pixels, and what is written to it is what vaGetImage reads. The
+ * surface can't go away before the image.
+ */
+static void
+check_derive_image(VADriverContextP ctx, VASurfaceID surface, const VAImage *src, const uint8_t *src_data)
+{
+    VAImage derived, image;
+    uint8_t *data, *read;
+
+    CHECK(vtable.vaDeriveImage(ctx, surface, &derived));
+    CHECK(vtable.vaMapBuffer(ctx, derived.buf, (void **) &data));
+    if (VA_FOURCC_NV12 != derived.format.fourcc || WIDTH != derived.width || HEIGHT != derived.height) {
+        fprintf(stderr, "derived image: %.4s %dx%d\n", (const char *) &derived.format.fourcc,
+                derived.width, derived.height);
+        failed = 1;
+    }
+    compare_plane("derived image", "Y", data + derived.offsets[0], derived.pitches[0], 1,
+                  src_data + src->offsets[0], src->pitches[0], WIDTH, HEIGHT);
+    compare_plane("derived image", "UV", data + derived.offsets[1], derived.pitches[1], 1,
+                  src_data + src->offsets[1], src->pitches[1], WIDTH + 1, (HEIGHT + 1) / 2);
+
+    if (VA_STATUS_ERROR_SURFACE_BUSY != vtable.vaDestroySurfaces(ctx, &surface, 1)) {
+        fprintf(stderr, "derived surface not reported busy\n");
+        failed = 1;
+    }
+
+    /* No copy in between */
+    data[derived.offsets[0] + derived.pitches[0] + 5] ^= 0xff;
+    image = create_image(ctx, VA_FOURCC_NV12, WIDTH, HEIGHT, &read);
+    CHECK(vtable.vaGetImage(ctx, surface, 0, 0, WIDTH, HEIGHT, image.image_id));
+    if (read[image.offsets[0] + image.pitches[0] + 5] != data[derived.offsets[0] + derived.pitches[0] + 5]) {
+        fprintf(stderr, "derived image: write not seen by vaGetImage\n");
+        failed = 1;
+    }
+    data[derived.offsets[0] + derived.pitches[0] + 5] ^= 0xff;
+    CHECK(vtable.vaUnmapBuffer(ctx, image.buf));
+    CHECK(vtable.vaDestroyImage(ctx, image.image_id));
+
+    CHECK(vtable.vaUnmapBuffer(ctx, derived.buf));
+    CHECK(vtable.vaDestroyImage(ctx, derived.image_id));
+}
+
+/*
+ * Checks the surface still holds its frame in the layout it was created
+ * in: the luma plane, detiled, is the one of ref
+ */
+static void
+check_layout(struct rockchip_driver_data *driver_data, VASurfaceID surface, int layout,
+             const VAImage *src, const uint8_t *ref)
+{
+    object_surface_p obj_surface =
+        (object_surface_p) object_heap_lookup(&driver_data->surface_heap, surface);
+    unsigned int tile_width, tile_height;
+    uint8_t luma[WIDTH * HEIGHT];
+
+    if (obj_surface->layout != layout) {
+        fprintf(stderr, "layout %d: surface changed to layout %d\n", layout, obj_surface->layout);
+        failed = 1;
+        return;
+    }
+
+    if (ROCKCHIP_SURFACE_LAYOUT_LINEAR == layout) {
+        image_convert_copy_plane(luma, WIDTH, obj_surface->data, obj_surface->pitches[0], WIDTH, HEIGHT);
+    } else {
+        tile_width = tile_height = ROCKCHIP_SURFACE_LAYOUT_TILE4X4 == layout ? 4 : 16;
+        image_convert_detile_plane(luma, WIDTH, obj_surface->data, obj_surface->pitches[0],
+                                   tile_width, tile_height, 0, 0, WIDTH, HEIGHT);
+    }
+    compare_plane("surface", "Y", luma, WIDTH, 1, ref + src->offsets[0], src->pitches[0], WIDTH, HEIGHT);
+}
+
+int
+main(void)
+{
+    VADriverContextP ctx = &context;
+    struct rockchip_driver_data *driver_data;
+    VASurfaceID surface;
+    VAImage src, derived;
+    uint8_t *src_data, *ref;
+    unsigned int i, y;
+    int caching, layout;
+
+    context.vtable = &vtable;
+    CHECK(VA_DRIVER_INIT_FUNC(ctx));
+    driver_data = ctx->pDriverData;
+
+    src = create_image(ctx, VA_FOURCC_NV12, WIDTH, HEIGHT, &src_data);
+    srand(1);
+    for (i = 0; i < src.data_size; i++)
+        src_data[i] = rand();
+
+    /* The frame after a partial upload: src, with the rect at (6, 4) replaced */
+    ref = malloc(src.data_size);
+    memcpy(ref, src_data, src.data_size);
+    for (y = 0; y < 20; y++) {
+        for (i = 0; i < 40; i++)
+            ref[src.offsets[0] + (4 + y) * src.pitches[0] + 6 + i] = ~src_data[src.offsets[0] + (4 + y) * src.pitches[0] + 6 + i];
+    }
+    for (y = 0; y < 10; y++) {
+        for (i = 0; i < 40; i++)
+            ref[src.offsets[1] + (2 + y) * src.pitches[1] + 6 + i] = ~src_data[src.offsets[1] + (2 + y) * src.pitches[1] + 6 + i];
+    }
+
+    /*
+     * Surfaces from an uncached dma-buf heap are read through the bounce
+     * buffer. No such heap is needed to take that path, only the label.
+     * The decoder layout applies to surfaces created after it is set.
+     */
+    for (layout = ROCKCHIP_SURFACE_LAYOUT_LINEAR; layout <= ROCKCHIP_SURFACE_LAYOUT_TILE16X16; layout++) {
+        for (caching = DMA_MEMORY_CACHED; caching <= DMA_MEMORY_WRITE_COMBINED; caching++) {
+            driver_data->surface_layout = layout;
+            driver_data->frame_arena.caching = caching;
+            CHECK(vtable.vaCreateSurfaces(ctx, WIDTH, HEIGHT, VA_RT_FORMAT_YUV420, 1, &surface));
+            CHECK(vtable.vaPutImage(ctx, surface, src.image_id, 0, 0, WIDTH, HEIGHT, 0, 0, WIDTH, HEIGHT));
+            check_layout(driver_data, surface, layout, &src, src_data);
+
+            /* 1:1 first, the others depend on it */
+            check_get_image(ctx, surface, &src, src_data, VA_FOURCC_NV12, 0, 0, WIDTH, HEIGHT, WIDTH, HEIGHT);
+            check_get_image(ctx, surface, &src, src_data, VA_FOURCC_I420, 3, 1, 90, 30, 90, 30);
+
+            check_get_image(ctx, surface, &src, src_data, VA_FOURCC_I420, 2, 4, 64, 32, 32, 16);
+            check_get_image(ctx, surface, &src, src_data, VA_FOURCC_YV12, 0, 0, 98, 36, 49, 18);
+            check_get_image(ctx, surface, &src, src_data, VA_FOURCC_NV12, 4, 0, 88, 32, 22, 8);
+            check_get_image(ctx, surface, &src, src_data, VA_FOURCC_NV12, 0, 0, WIDTH, HEIGHT, 40, 15);
+            check_get_image(ctx, surface, &src, src_data, VA_FOURCC_I420, 6, 2, 93, 35, 31, 17);
+            check_get_image(ctx, surface, &src, src_data, VA_FOURCC_YV12, 1, 1, 97, 35, 50, 20);
+            check_layout(driver_data, surface, layout, &src, src_data);
+
+            /* Tiled frames can't be derived, linear ones are */
+            if (ROCKCHIP_SURFACE_LAYOUT_LINEAR == layout) {
+                check_derive_image(ctx, surface, &src, src_data);
+            } else if (VA_STATUS_SUCCESS == vtable.vaDeriveImage(ctx, surface, &derived)) {
+                fprintf(stderr, "layout %d: tiled surface derived\n", layout);
+                failed = 1;
+                CHECK(vtable.vaDestroyImage(ctx, derived.image_id));
+            }
+
+            /* A partial upload keeps the pixels around the rect */
+            for (i = 0; i < src.data_size; i++)
+                src_data[i] = ~src_data[i];
+            CHECK(vtable.vaPutImage(ctx, surface, src.image_id, 6, 4, 40, 20, 6, 4, 40, 20));
+            for (i = 0; i < src.data_size; i++)
+                src_data[i] = ~src_data[i];
+            check_layout(driver_data, surface, layout, &src, ref);
+            check_get_image(ctx, surface, &src, ref, VA_FOURCC_NV12, 0, 0, WIDTH, HEIGHT, WIDTH, HEIGHT);
+            check_get_image(ctx, surface, &src, ref, VA_FOURCC_I420, 2, 4, 64, 32, 32, 16);
+
+            CHECK(vtable.vaDestroySurfaces(ctx, &surface, 1));
+        }
+    }
+
+    free(ref);
+
+    CHECK(vtable.vaUnmapBuffer(ctx, src.buf));
+    CHECK(vtable.vaDestroyImage(ctx, src.image_id));
+    CHECK(vtable.vaTerminate(ctx));
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,633 @@
+/*
+ * Copyright (c) 2015 - 2016 Rockchip Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Checks every vector level of the readback kernels against the scalar
+ * reference, over widths that leave every possible tail, detiling
+ * against planes tiled the way the decoder writes them and scaling
+ * against reference box and bilinear filters. Then reports
+ * their throughput at 1080p and 4K. Throughput counts the bytes of the
+ * NV12 frame read per second, and samples per second for NV15 and P010.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cpu_features.h"
+#include "image_convert.h"
+
+#define MAX_TEST_WIDTH  200
+/* NV15 rows hold whole groups of four samples */
+#define NV15_ROW_BYTES(n)   ((n) * 10 / 8)
+#define BENCH_SECONDS   0.1
+
+static const char *const levels[] = {
+    "scalar", "sse2", "ssse3", "sse4.1", "avx2", "neon", "sve",
+};
+
+static int failed;
+
+#define CHECK(cond)                                                     \
+    do {                                                                \
+        if (!(cond)) {                                                  \
+            fprintf(stderr, "%s:%d: check failed: %s\n",                \
+                    __FILE__, __LINE__, #cond);                         \
+            failed = 1;                                                 \
+        }                                                               \
+    } while (0)
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+fill_random(uint8_t *data, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < size; i++)
+        data[i] = rand();
+}
+
+/*
+ * Binds the kernels to a named level.
+ * Returns 0 if the CPU has it, -1 if not
+ */
+static int
+select_level(const char *level)
+{
+    unsigned int features = cpu_features_probe();
+
+    if (cpu_features_limit(&features, level) || strcmp(cpu_features_name(features), level))
+        return -1;
+    image_convert_init(features);
+    return 0;
+}
+
+static void
+check_deinterleave(const char *level)
+{
+    uint8_t uv[2 * MAX_TEST_WIDTH + 1];
+    uint8_t u[MAX_TEST_WIDTH + 1], v[MAX_TEST_WIDTH + 1];
+    uint8_t ref_u[MAX_TEST_WIDTH + 1], ref_v[MAX_TEST_WIDTH + 1];
+    unsigned int n, offset;
+
+    for (n = 0; n < MAX_TEST_WIDTH; n++) {
+        /* Odd source offsets exercise the unaligned loads */
+        for (offset = 0; offset < 2; offset++) {
+            fill_random(uv, sizeof(uv));
+            memset(u, 0xee, sizeof(u));
+            memset(v, 0xee, sizeof(v));
+            memset(ref_u, 0xee, sizeof(ref_u));
+            memset(ref_v, 0xee, sizeof(ref_v));
+            image_convert_deinterleave_c(ref_u, ref_v, uv + offset, n);
+            image_convert_deinterleave(u, v, uv + offset, n);
+            if (memcmp(u, ref_u, sizeof(u)) || memcmp(v, ref_v, sizeof(v))) {
+                fprintf(stderr, "%s: deinterleave of %u pairs differs\n", level, n);
+                failed = 1;
+                return;
+            }
+        }
+    }
+}
+
+static void
+check_interleave(const char *level)
+{
+    uint8_t u[MAX_TEST_WIDTH + 1], v[MAX_TEST_WIDTH + 1];
+    uint8_t uv[2 * MAX_TEST_WIDTH + 2], ref_uv[2 * MAX_TEST_WIDTH + 2];
+    unsigned int n, offset;
+
+    for (n = 0; n < MAX_TEST_WIDTH; n++) {
+        /* Odd destination offsets exercise the unaligned stores */
+        for (offset = 0; offset < 2; offset++) {
+            fill_random(u, sizeof(u));
+            fill_random(v, sizeof(v));
+            memset(uv, 0xee, sizeof(uv));
+            memset(ref_uv, 0xee, sizeof(ref_uv));
+            image_convert_interleave_c(ref_uv + offset, u + offset, v, n);
+            image_convert_interleave(uv + offset, u + offset, v, n);
+            if (memcmp(uv, ref_uv, sizeof(uv))) {
+                fprintf(stderr, "%s: interleave of %u pairs differs\n", level, n);
+                failed = 1;
+                return;
+            }
+        }
+    }
+}
+
+/*
+ * Streams rows of every length, from and to every alignment within a
+ * vector, and compares with memcpy. Nothing past the row may change.
+ */
+static void
+check_read_uncached(const char *level)
+{
+    uint8_t src[4 * MAX_TEST_WIDTH + 64] __attribute__((aligned(64)));
+    uint8_t dst[4 * MAX_TEST_WIDTH + 64 + 1] __attribute__((aligned(64)));
+    uint8_t ref[4 * MAX_TEST_WIDTH + 64 + 1] __attribute__((aligned(64)));
+    unsigned int n, src_offset, dst_offset;
+
+    fill_random(src, sizeof(src));
+    for (n = 0; n <= 4 * MAX_TEST_WIDTH; n++) {
+        for (src_offset = 0; src_offset < 32; src_offset += 1 + n % 7) {
+            dst_offset = (src_offset + n) % 32;
+            memset(dst, 0xee, sizeof(dst));
+            memset(ref, 0xee, sizeof(ref));
+            memcpy(ref + dst_offset, src + src_offset, n);
+            image_convert_read_uncached(dst + dst_offset, src + src_offset, n);
+            if (memcmp(dst, ref, sizeof(dst))) {
+                fprintf(stderr, "%s: read_uncached of %u bytes from +%u to +%u differs\n",
+                        level, n, src_offset, dst_offset);
+                failed = 1;
+                return;
+            }
+        }
+    }
+}
+
+/*
+ * Unpacks random NV15 rows of every length and packs them back, both
+ * ways bit exact with the scalar kernels, from odd addresses too. The
+ * packer must not write past the row.
+ */
+static void
+check_nv15(const char *level)
+{
+    uint8_t src[NV15_ROW_BYTES(MAX_TEST_WIDTH) + 1];
+    uint8_t packed[NV15_ROW_BYTES(MAX_TEST_WIDTH) + 16];
+    uint8_t ref_packed[NV15_ROW_BYTES(MAX_TEST_WIDTH) + 16];
+    uint16_t unpacked[MAX_TEST_WIDTH + 8], ref_unpacked[MAX_TEST_WIDTH + 8];
+    unsigned int n, offset;
+
+    for (n = 0; n <= MAX_TEST_WIDTH; n += 4) {
+        for (offset = 0; offset < 2; offset++) {
+            fill_random(src, sizeof(src));
+            memset(unpacked, 0xee, sizeof(unpacked));
+            memset(ref_unpacked, 0xee, sizeof(ref_unpacked));
+            image_convert_nv15_to_p010_row_c(ref_unpacked, src + offset, n);
+            image_convert_nv15_to_p010_row(unpacked, src + offset, n);
+            if (memcmp(unpacked, ref_unpacked, sizeof(unpacked))) {
+                fprintf(stderr, "%s: nv15_to_p010 of %u samples differs\n", level, n);
+                failed = 1;
+                return;
+            }
+
+            memset(packed, 0xee, sizeof(packed));
+            memset(ref_packed, 0xee, sizeof(ref_packed));
+            image_convert_p010_to_nv15_row_c(ref_packed + offset, unpacked, n);
+            image_convert_p010_to_nv15_row(packed + offset, unpacked, n);
+            if (memcmp(packed, ref_packed, sizeof(packed)) ||
+                memcmp(packed + offset, src + offset, NV15_ROW_BYTES(n)) ||
+                packed[offset + NV15_ROW_BYTES(n)] != 0xee) {
+                fprintf(stderr, "%s: p010_to_nv15 of %u samples differs\n", level, n);
+                failed = 1;
+                return;
+            }
+        }
+    }
+}
+
+/*
+ * Tiles a random plane in every supported layout and reads rects of it
+ * back, which must match the linear plane.
+ */
+static void
+check_detile(const char *level)
+{
+    static const unsigned int tiles[][2] = { { 4, 4 }, { 4, 2 }, { 16, 16 }, { 16, 8 } };
+    const unsigned int pitch = 128, height = 64;
+    uint8_t *linear = malloc(pitch * height);
+    uint8_t *tiled = malloc(pitch * height);
+    uint8_t *out = malloc(pitch * height);
+    unsigned int t, k, x, y, width, rows, row;
+
+    CHECK(linear && tiled && out);
+    for (t = 0; linear && tiled && out && t < sizeof(tiles) / sizeof(tiles[0]); t++) {
+        fill_random(linear, pitch * height);
+        image_convert_tile_plane(tiled, pitch, linear, pitch, tiles[t][0], tiles[t][1], 0, pitch, height);
+        for (k = 0; k < 200; k++) {
+            x = k ? rand() % pitch : 0;
+            y = k ? rand() % height : 0;
+            width = k ? 1 + rand() % (pitch - x) : pitch;
+            rows = k ? 1 + rand() % (height - y) : height;
+            image_convert_detile_plane(out, pitch, tiled, pitch, tiles[t][0], tiles[t][1],
+                                       x, y, width, rows);
+            for (row = 0; row < rows; row++) {
+                if (memcmp(out + row * pitch, linear + (y + row) * pitch + x, width)) {
+                    fprintf(stderr, "%s: %ux%u detile of %ux%u at %u,%u differs\n",
+                            level, tiles[t][0], tiles[t][1], width, rows, x, y);
+                    failed = 1;
+                    k = 200;
+                    t = sizeof(tiles) / sizeof(tiles[0]);
+                    break;
+                }
+            }
+        }
+    }
+    free(linear);
+    free(tiled);
+    free(out);
+}
+
+/*
+ * Box filter reference: the rounded mean of each factor x factor block
+ */
+static void
+scale_box_ref(uint8_t *dst, unsigned int dst_pitch, unsigned int dst_step,
+              const uint8_t *src, unsigned int src_pitch, unsigned int src_step,
+              unsigned int dst_width, unsigned int dst_height, unsigned int factor)
+{
+    unsigned int x, y, i, j, sum;
+
+    for (y = 0; y < dst_height; y++) {
+        for (x = 0; x < dst_width; x++) {
+            sum = 0;
+            for (j = 0; j < factor; j++)
+                for (i = 0; i < factor; i++)
+                    sum += src[(y * factor + j) * src_pitch + (x * factor + i) * src_step];
+            dst[y * dst_pitch + x * dst_step] = (sum + factor * factor / 2) / (factor * factor);
+        }
+    }
+}
+
+/* Bilinear reference in floating point, sample centres aligned and edges clamped */
+static double
+scale_source_pos(unsigned int i, unsigned int src_size, unsigned int dst_size)
+{
+    double pos = (i + 0.5) * src_size / dst_size - 0.5;
+
+    return pos < 0 ? 0 : pos > src_size - 1 ? src_size - 1 : pos;
+}
+
+static void
+scale_bilinear_ref(uint8_t *dst, unsigned int dst_pitch, unsigned int dst_step,
+                   const uint8_t *src, unsigned int src_pitch, unsigned int src_step,
+                   unsigned int src_width, unsigned int src_height,
+                   unsigned int dst_width, unsigned int dst_height)
+{
+    unsigned int x, y, x0, x1, y0, y1;
+    double fx, fy, top, bottom;
+
+    for (y = 0; y < dst_height; y++) {
+        fy = scale_source_pos(y, src_height, dst_height);
+        y0 = fy;
+        y1 = y0 + 1 < src_height ? y0 + 1 : y0;
+        for (x = 0; x < dst_width; x++) {
+            fx = scale_source_pos(x, src_width, dst_width);
+            x0 = fx;
+            x1 = x0 + 1 < src_width ? x0 + 1 : x0;
+            top = src[y0 * src_pitch + x0 * src_step] * (1 - (fx - x0)) +
+                  src[y0 * src_pitch + x1 * src_step] * (fx - x0);
+            bottom = src[y1 * src_pitch + x0 * src_step] * (1 - (fx - x0)) +
+                     src[y1 * src_pitch + x1 * src_step] * (fx - x0);
+            dst[y * dst_pitch + x * dst_step] = top * (1 - (fy - y0)) + bottom * (fy - y0) + 0.5;
+        }
+    }
+}
+
+/*
+ * Scales random planes, whole and in bands of three rows, luma and one
+ * half of interleaved chroma. Box reductions must match exactly, every
+ * 2:1 width so the vector rows see every tail. Bilinear output carries
+ * 8 bit weights and may be off by 2.
+ */
+static void
+check_scale(const char *level)
+{
+    static const unsigned int sizes[][4] = {
+        { 36, 20, 9, 5 }, { 72, 40, 9, 5 },             /* 4:1, 8:1 */
+        { 37, 23, 20, 11 }, { 33, 17, 33, 9 },          /* odd sources */
+        { 101, 3, 50, 2 }, { 7, 5, 20, 13 },            /* enlargement */
+        { 1, 1, 3, 2 },
+    };
+    const unsigned int src_pitch = 2 * 2 * MAX_TEST_WIDTH, dst_pitch = 2 * MAX_TEST_WIDTH;
+    uint8_t *src = malloc(src_pitch * 48);
+    uint8_t *dst = malloc(dst_pitch * 24);
+    uint8_t *ref = malloc(dst_pitch * 24);
+    unsigned int k, n, step, sw, sh, dw, dh, x, y, row;
+    int box;
+
+    CHECK(src && dst && ref);
+    for (k = 0; src && dst && ref && k < MAX_TEST_WIDTH + sizeof(sizes) / sizeof(sizes[0]); k++) {
+        if (k < MAX_TEST_WIDTH) {
+            dw = k + 1;
+            dh = 1 + k % 7;
+            sw = 2 * dw;
+            sh = 2 * dh;
+        } else {
+            sw = sizes[k - MAX_TEST_WIDTH][0];
+            sh = sizes[k - MAX_TEST_WIDTH][1];
+            dw = sizes[k - MAX_TEST_WIDTH][2];
+            dh = sizes[k - MAX_TEST_WIDTH][3];
+        }
+        box = sw == 2 * dw || sw == 4 * dw || sw == 8 * dw;
+
+        for (step = 1; step <= 2; step++) {
+            fill_random(src, src_pitch * 48);
+            memset(dst, 0xee, dst_pitch * 24);
+            memset(ref, 0xee, dst_pitch * 24);
+            if (box)
+                scale_box_ref(ref, dst_pitch, step, src, src_pitch, step, dw, dh, sw / dw);
+            else
+                scale_bilinear_ref(ref, dst_pitch, step, src, src_pitch, step, sw, sh, dw, dh);
+
+            for (n = 0; n < 2; n++) {
+                if (n)
+                    for (row = 0; row < dh; row += 3)
+                        image_convert_scale_plane(dst, dst_pitch, step, src, src_pitch, step,
+                                                  sw, sh, dw, dh, row, 3);
+                else
+                    image_convert_scale_plane(dst, dst_pitch, step, src, src_pitch, step,
+                                              sw, sh, dw, dh, 0, dh);
+
+                for (y = 0; y < dh; y++) {
+                    for (x = 0; x < dw * step; x++) {
+                        int d = dst[y * dst_pitch + x] - ref[y * dst_pitch + x];
+
+                        if (box || x % step ? d != 0 : d < -2 || d > 2) {
+                            fprintf(stderr, "%s: %ux%u to %ux%u scale with step %u differs at %u,%u\n",
+                                    level, sw, sh, dw, dh, step, x, y);
+                            failed = 1;
+                            goto out;
+                        }
+                    }
+                }
+            }
+        }
+    }
+out:
+    free(src);
+    free(dst);
+    free(ref);
+}
+
+/* Converts a random frame of every small size and compares with scalar */
+static void
+check_nv12_to_yuv420(const char *level)
+{
+    unsigned int pitch = MAX_TEST_WIDTH + 64;
+    unsigned int height = 6;
+    size_t src_size = pitch * height * 3 / 2;
+    size_t dst_size = MAX_TEST_WIDTH * height * 2;
+    uint8_t *src = malloc(src_size);
+    uint8_t *dst = malloc(dst_size);
+    uint8_t *ref = malloc(dst_size);
+    unsigned int width;
+
+    CHECK(src && dst && ref);
+    for (width = 1; src && dst && ref && width < MAX_TEST_WIDTH; width++) {
+        unsigned int chroma_width = (width + 1) / 2;
+        size_t y_size = width * height;
+        size_t c_size = chroma_width * ((height + 1) / 2);
+
+        fill_random(src, src_size);
+        memset(dst, 0xee, dst_size);
+        memset(ref, 0xee, dst_size);
+
+        image_convert_init(0);
+        image_convert_nv12_to_yuv420(ref, width, ref + y_size, chroma_width,
+                                     ref + y_size + c_size, chroma_width,
+                                     src, pitch, src + pitch * height, pitch,
+                                     width, height);
+        select_level(level);
+        image_convert_nv12_to_yuv420(dst, width, dst + y_size, chroma_width,
+                                     dst + y_size + c_size, chroma_width,
+                                     src, pitch, src + pitch * height, pitch,
+                                     width, height);
+        if (memcmp(dst, ref, dst_size)) {
+            fprintf(stderr, "%s: nv12_to_yuv420 at width %u differs\n", level, width);
+            failed = 1;
+            break;
+        }
+    }
+    free(src);
+    free(dst);
+    free(ref);
+}
+
+/*
+ * Converts random NV12 frames of every width up to 300, from odd
+ * addresses too, to each packed and high bit depth layout and compares
+ * with scalar. Three lines leave the last chroma line half used.
+ */
+static void
+check_packed(const char *level)
+{
+    enum { YUY2, UYVY, RGBX, BGRX, P010, NUM_PACKED };
+    static const char *const names[NUM_PACKED] = { "yuy2", "uyvy", "rgbx", "bgrx", "p010" };
+    const unsigned int max_width = 3 * MAX_TEST_WIDTH / 2;
+    const unsigned int src_pitch = max_width + 64, dst_pitch = 4 * max_width + 16;
+    const unsigned int height = 3;
+    size_t src_size = src_pitch * (height + 1) * 3 / 2;
+    size_t dst_size = dst_pitch * height * 2;
+    uint8_t *src = malloc(src_size);
+    uint8_t *dst = malloc(dst_size);
+    uint8_t *ref = malloc(dst_size);
+    unsigned int width, offset, format;
+
+    CHECK(src && dst && ref);
+    for (width = 1; src && dst && ref && width < max_width; width++) {
+        offset = width % 3 ? 0 : 1;
+        fill_random(src, src_size);
+        for (format = 0; format < NUM_PACKED; format++) {
+            const uint8_t *src_y = src + offset;
+            const uint8_t *src_uv = src + src_pitch * (height + 1) + offset;
+            uint8_t *out;
+            int pass;
+
+            memset(dst, 0xee, dst_size);
+            memset(ref, 0xee, dst_size);
+            for (pass = 0; pass < 2; pass++) {
+                if (pass)
+                    select_level(level);
+                else
+                    image_convert_init(0);
+                out = pass ? dst : ref;
+
+                switch (format) {
+                case YUY2:
+                    image_convert_nv12_to_yuy2(out, dst_pitch, src_y, src_pitch, src_uv, src_pitch, width, height);
+                    break;
+                case UYVY:
+                    image_convert_nv12_to_uyvy(out, dst_pitch, src_y, src_pitch, src_uv, src_pitch, width, height);
+                    break;
+                case RGBX:
+                    image_convert_nv12_to_rgbx(out, dst_pitch, src_y, src_pitch, src_uv, src_pitch, width, height);
+                    break;
+                case BGRX:
+                    image_convert_nv12_to_bgrx(out, dst_pitch, src_y, src_pitch, src_uv, src_pitch, width, height);
+                    break;
+                case P010:
+                    image_convert_nv12_to_p010(out, dst_pitch, out + dst_pitch * height, dst_pitch,
+                                               src_y, src_pitch, src_uv, src_pitch, width, height);
+                    break;
+                }
+            }
+            if (memcmp(dst, ref, dst_size)) {
+                fprintf(stderr, "%s: nv12_to_%s at width %u differs\n", level, names[format], width);
+                failed = 1;
+                width = max_width;
+                break;
+            }
+        }
+    }
+    free(src);
+    free(dst);
+    free(ref);
+}
+
+/* The vaPutImage direction: I420 frames of every small size into NV12 */
+static void
+check_yuv420_to_nv12(const char *level)
+{
+    unsigned int pitch = MAX_TEST_WIDTH + 64;
+    unsigned int height = 6;
+    size_t src_size = MAX_TEST_WIDTH * height * 2;
+    size_t dst_size = pitch * height * 3 / 2;
+    uint8_t *src = malloc(src_size);
+    uint8_t *dst = malloc(dst_size);
+    uint8_t *ref = malloc(dst_size);
+    unsigned int width;
+
+    CHECK(src && dst && ref);
+    for (width = 1; src && dst && ref && width < MAX_TEST_WIDTH; width++) {
+        unsigned int chroma_width = (width + 1) / 2;
+        size_t y_size = width * height;
+        size_t c_size = chroma_width * ((height + 1) / 2);
+
+        fill_random(src, src_size);
+        memset(dst, 0xee, dst_size);
+        memset(ref, 0xee, dst_size);
+
+        image_convert_init(0);
+        image_convert_yuv420_to_nv12(ref, pitch, ref + pitch * height, pitch,
+                                     src, width, src + y_size, chroma_width,
+                                     src + y_size + c_size, chroma_width,
+                                     width, height);
+        select_level(level);
+        image_convert_yuv420_to_nv12(dst, pitch, dst + pitch * height, pitch,
+                                     src, width, src + y_size, chroma_width,
+                                     src + y_size + c_size, chroma_width,
+                                     width, height);
+        if (memcmp(dst, ref, dst_size)) {
+            fprintf(stderr, "%s: yuv420_to_nv12 at width %u differs\n", level, width);
+            failed = 1;
+            break;
+        }
+    }
+    free(src);
+    free(dst);
+    free(ref);
+}
+
+static void
+bench(const char *level, unsigned int width, unsigned int height)
+{
+    unsigned int pitch = (width + 63) & ~63;
+    unsigned int nv15_pitch = (NV15_ROW_BYTES(width) + 63) & ~63;
+    /* Large enough for P010 too */
+    size_t frame_size = (size_t) pitch * height * 3;
+    uint8_t *src = malloc(frame_size);
+    uint8_t *dst = malloc(frame_size);
+    uint8_t *dst_u, *dst_v;
+    double start, elapsed, copy_rate, convert_rate, unpack_rate, pack_rate;
+    unsigned int i;
+
+    if (!src || !dst) {
+        CHECK(src && dst);
+        free(src);
+        free(dst);
+        return;
+    }
+    fill_random(src, frame_size);
+    dst_u = dst + (size_t) width * height;
+    dst_v = dst_u + (size_t) width * height / 4;
+
+    start = now();
+    for (i = 0; (elapsed = now() - start) < BENCH_SECONDS; i++) {
+        image_convert_copy_plane(dst, width, src, pitch, width, height);
+        image_convert_copy_plane(dst_u, width, src + (size_t) pitch * height, pitch, width, height / 2);
+    }
+    copy_rate = (double) width * height * 3 / 2 * i / elapsed / 1e9;
+
+    start = now();
+    for (i = 0; (elapsed = now() - start) < BENCH_SECONDS; i++)
+        image_convert_nv12_to_yuv420(dst, width, dst_u, width / 2, dst_v, width / 2,
+                                     src, pitch, src + (size_t) pitch * height, pitch,
+                                     width, height);
+    convert_rate = (double) width * height * 3 / 2 * i / elapsed / 1e9;
+
+    start = now();
+    for (i = 0; (elapsed = now() - start) < BENCH_SECONDS; i++)
+        image_convert_nv15_to_p010(dst, width * 2, dst + (size_t) width * 2 * height, width * 2,
+                                   src, nv15_pitch, src + (size_t) nv15_pitch * height, nv15_pitch,
+                                   width, height);
+    unpack_rate = (double) width * height * 3 / 2 * i / elapsed / 1e9;
+
+    start = now();
+    for (i = 0; (elapsed = now() - start) < BENCH_SECONDS; i++)
+        image_convert_p010_to_nv15(src, nv15_pitch, src + (size_t) nv15_pitch * height, nv15_pitch,
+                                   dst, width * 2, dst + (size_t) width * 2 * height, width * 2,
+                                   width, height);
+    pack_rate = (double) width * height * 3 / 2 * i / elapsed / 1e9;
+
+    printf("%-7s %4ux%-4u copy %6.2f GB/s   nv12->i420 %6.2f GB/s   "
+           "nv15->p010 %5.2f Gsamples/s   p010->nv15 %5.2f Gsamples/s\n",
+           level, width, height, copy_rate, convert_rate, unpack_rate, pack_rate);
+    free(src);
+    free(dst);
+}
+
+int
+main(void)
+{
+    unsigned int i;
+
+    srand(1);
+    for (i = 0; i < sizeof(levels) / sizeof(levels[0]); i++) {
+        if (select_level(levels[i]))
+            continue;
+        check_deinterleave(levels[i]);
+        check_read_uncached(levels[i]);
+        check_interleave(levels[i]);
+        check_nv12_to_yuv420(levels[i]);
+        check_yuv420_to_nv12(levels[i]);
+        check_packed(levels[i]);
+        check_nv15(levels[i]);
+        check_detile(levels[i]);
+        check_scale(levels[i]);
+        select_level(levels[i]);
+        bench(levels[i], 1920, 1080);
+        bench(levels[i], 3840, 2160);
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2015 - 2016 Rockchip Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Glass-to-glass latency of the low latency mode against the default.
+ * Slices of every frame arrive one at a time, as from a network, and
+ * the simulated decoder takes ROCKCHIP_VA_DECODE_RATE per byte. A frame
+ * counts from the moment its first slice could be sent until
+ * vaSyncSurface returns; the part after vaEndPicture is what the
+ * decoder adds to the upload. Streaming must save most of the decode
+ * time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <va/va_backend.h>
+
+#include "config.h"
+#include "rockchip_drv_video.h"
+
+#define NUM_FRAMES      12
+#define NUM_SLICES      8
+#define SLICE_BYTES     (16 * 1024)
+#define SLICE_INTERVAL  2000000         /* ns between slice arrivals */
+#define DECODE_RATE     "10"            /* MB/s, 1.6 ms per slice */
+
+VAStatus VA_DRIVER_INIT_FUNC(VADriverContextP ctx);
+
+static struct VADriverVTable vtable;
+static struct VADriverContext context;
+
+#define CHECK(call)                                                     \
+    do {                                                                \
+        VAStatus status_ = (call);                                      \
+        if (VA_STATUS_SUCCESS != status_) {                             \
+            fprintf(stderr, "%s:%d: %s failed: 0x%x\n",                 \
+                    __FILE__, __LINE__, #call, status_);                \
+            exit(1);                                                    \
+        }                                                               \
+    } while (0)
+
+static uint64_t
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void
+sleep_until(uint64_t time)
+{
+    struct timespec ts;
+
+    ts.tv_sec = time / 1000000000;
+    ts.tv_nsec = time % 1000000000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL))
+        ;
+}
+
+/*
+ * Decodes NUM_FRAMES frames on a fresh context.
+ * Returns the average latency in ns, *max gets the worst and *tail the
+ * average after vaEndPicture
+ */
+static uint64_t
+run(VADriverContextP ctx, int low_latency, uint64_t *max, uint64_t *tail)
+{
+    static char slice[SLICE_BYTES];
+    VAConfigAttrib attrib;
+    VAConfigID config;
+    VAContextID va_context;
+    VASurfaceID surface;
+    VABufferID buffer;
+    uint64_t start, end, done, latency, sum = 0, tail_sum = 0;
+    int frame, i;
+
+    attrib.type = (VAConfigAttribType) ROCKCHIP_CONFIG_ATTRIB_LOW_LATENCY;
+    attrib.value = low_latency;
+    CHECK(vtable.vaCreateConfig(ctx, VAProfileH264High, VAEntrypointVLD, &attrib, 1, &config));
+    CHECK(vtable.vaCreateSurfaces(ctx, 1280, 720, VA_RT_FORMAT_YUV420, 1, &surface));
+    CHECK(vtable.vaCreateContext(ctx, config, 1280, 720, 0, &surface, 1, &va_context));
+
+    *max = 0;
+    for (frame = 0; frame < NUM_FRAMES; frame++) {
+        start = now();
+        CHECK(vtable.vaBeginPicture(ctx, va_context, surface));
+
+        /* An open streamed picture can't be waited for, it must not hang either */
+        if (low_latency && 0 == frame &&
+            (VA_STATUS_ERROR_SURFACE_BUSY != vtable.vaSyncSurface(ctx, surface) ||
+             VA_STATUS_ERROR_SURFACE_BUSY != vtable.vaDestroySurfaces(ctx, &surface, 1))) {
+            fprintf(stderr, "open low latency picture not reported busy\n");
+            exit(1);
+        }
+
+        for (i = 0; i < NUM_SLICES; i++) {
+            sleep_until(start + (uint64_t) (i + 1) * SLICE_INTERVAL);
+            CHECK(vtable.vaCreateBuffer(ctx, va_context, VASliceDataBufferType,
+                                        SLICE_BYTES, 1, slice, &buffer));
+            CHECK(vtable.vaRenderPicture(ctx, va_context, &buffer, 1));
+        }
+        CHECK(vtable.vaEndPicture(ctx, va_context));
+        end = now();
+        CHECK(vtable.vaSyncSurface(ctx, surface));
+
+        done = now();
+        latency = done - start;
+        sum += latency;
+        tail_sum += done - end;
+        if (latency > *max)
+            *max = latency;
+    }
+
+    CHECK(vtable.vaDestroyContext(ctx, va_context));
+    CHECK(vtable.vaDestroySurfaces(ctx, &surface, 1));
+    CHECK(vtable.vaDestroyConfig(ctx, config));
+    *tail = tail_sum / NUM_FRAMES;
+    return sum / NUM_FRAMES;
+}
+
+int
+main(void)
+{
+    uint64_t normal, normal_max, normal_tail, streamed, streamed_max, streamed_tail;
+
+    setenv("ROCKCHIP_VA_DECODE_RATE", DECODE_RATE, 1);
+    context.vtable = &vtable;
+    CHECK(VA_DRIVER_INIT_FUNC(&context));
+
+    normal = run(&context, 0, &normal_max, &normal_tail);
+    streamed = run(&context, 1, &streamed_max, &streamed_tail);
+    CHECK(vtable.vaTerminate(&context));
+
+    printf("default:     %5.1f ms average, %5.1f ms at most, %5.1f ms after vaEndPicture\n",
+           normal / 1e6, normal_max / 1e6, normal_tail / 1e6);
+    printf("low latency: %5.1f ms average, %5.1f ms at most, %5.1f ms after vaEndPicture\n",
+           streamed / 1e6, streamed_max / 1e6, streamed_tail / 1e6);
+
+    /* Upload takes NUM_SLICES intervals either way, streaming hides all but the last slice's decode */
+    if (streamed >= normal || streamed_tail >= normal_tail) {
+        fprintf(stderr, "streaming slices did not reduce latency\n");
+        return 1;
+    }
+    return 0;
+}
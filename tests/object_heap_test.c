@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2015 - 2016 Rockchip Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Lookup contention test for object_heap. Reader threads look up a fixed
+ * set of objects while two threads keep allocating and freeing others, so
+ * lookups race with bucket growth, magazine traffic and trimming. Every
+ * lookup must return the object it asked for. Lookup throughput is
+ * reported for 1 to 8 readers, for both heap modes. Both modes must also
+ * hold more objects than a client keeps alive at any one time.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "object_heap.h"
+
+#define NUM_STABLE      64
+#define NUM_LOOKUPS     (1 << 21)
+#define NUM_CHURN       (1 << 17)
+#define CHURN_BURST     48
+#define MAX_READERS     8
+#define NUM_CAPACITY    (1 << 17)
+
+struct test_object {
+    struct object_base base;
+    int value;
+};
+
+static struct object_heap heap;
+static int stable_ids[NUM_STABLE];
+static int failed;
+
+#define CHECK(cond)                                                     \
+    do {                                                                \
+        if (!(cond)) {                                                  \
+            fprintf(stderr, "%s:%d: check failed: %s\n",                \
+                    __FILE__, __LINE__, #cond);                         \
+            __atomic_store_n(&failed, 1, __ATOMIC_RELAXED);             \
+        }                                                               \
+    } while (0)
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void *
+reader_thread(void *data)
+{
+    int i;
+
+    (void) data;
+    for (i = 0; i < NUM_LOOKUPS; i++) {
+        int id = stable_ids[i % NUM_STABLE];
+        struct test_object *obj = (struct test_object *) object_heap_lookup(&heap, id);
+
+        if (!obj || obj->base.id != id || obj->value != id) {
+            CHECK(obj && obj->base.id == id && obj->value == id);
+            break;
+        }
+    }
+    return NULL;
+}
+
+/* Bursts of allocations push the heap to grow, draining them lets it trim */
+static void *
+churn_thread(void *data)
+{
+    int ids[CHURN_BURST];
+    int i, j;
+
+    (void) data;
+    for (i = 0; i < NUM_CHURN / CHURN_BURST; i++) {
+        int n = 1 + i % CHURN_BURST;
+
+        for (j = 0; j < n; j++) {
+            struct test_object *obj;
+
+            ids[j] = object_heap_allocate(&heap);
+            obj = (struct test_object *) object_heap_lookup(&heap, ids[j]);
+            CHECK(obj && obj->base.id == ids[j]);
+            if (obj)
+                obj->value = -1;
+        }
+        for (j = 0; j < n; j++)
+            object_heap_free(&heap, object_heap_lookup(&heap, ids[j]));
+    }
+    return NULL;
+}
+
+/*
+ * Allocates NUM_CAPACITY objects at once, past what a flat heap used to
+ * reserve. Freeing them all must give all but the slack back.
+ */
+static int
+check_capacity(int flags)
+{
+    static int ids[NUM_CAPACITY];
+    static object_base_p objs[NUM_CAPACITY];
+
+    if (object_heap_init(&heap, sizeof(struct test_object), 0x08000000, flags)) {
+        fprintf(stderr, "object_heap_init(%d) failed\n", flags);
+        return -1;
+    }
+
+    CHECK(0 == object_heap_allocate_n(&heap, NUM_CAPACITY, ids));
+    CHECK(0 == object_heap_lookup_n(&heap, ids, NUM_CAPACITY, objs));
+    CHECK(objs[NUM_CAPACITY - 1] && objs[NUM_CAPACITY - 1]->id == ids[NUM_CAPACITY - 1]);
+
+    object_heap_free_n(&heap, objs, NUM_CAPACITY);
+    CHECK(heap.heap_size <= OBJECT_HEAP_TRIM_THRESHOLD);
+    CHECK(object_heap_lookup(&heap, ids[NUM_CAPACITY - 1]) == NULL);
+
+    /* Released buckets or pages come back on the next burst */
+    CHECK(0 == object_heap_allocate_n(&heap, NUM_CAPACITY / 2, ids));
+    CHECK(0 == object_heap_lookup_n(&heap, ids, NUM_CAPACITY / 2, objs));
+    object_heap_free_n(&heap, objs, NUM_CAPACITY / 2);
+    object_heap_destroy(&heap);
+    return 0;
+}
+
+static int
+run(int flags)
+{
+    object_heap_iterator iter;
+    object_base_p obj;
+    int num_readers, i, count;
+
+    if (object_heap_init(&heap, sizeof(struct test_object), 0x08000000, flags)) {
+        fprintf(stderr, "object_heap_init(%d) failed\n", flags);
+        return -1;
+    }
+
+    for (i = 0; i < NUM_STABLE; i++) {
+        stable_ids[i] = object_heap_allocate(&heap);
+        obj = object_heap_lookup(&heap, stable_ids[i]);
+        CHECK(obj != NULL);
+        if (obj)
+            ((struct test_object *) obj)->value = stable_ids[i];
+    }
+    CHECK(object_heap_lookup(&heap, -1) == NULL);
+    CHECK(object_heap_lookup(&heap, 0x08000000 + 0x00FFFFFF) == NULL);
+
+    for (num_readers = 1; num_readers <= MAX_READERS; num_readers *= 2) {
+        pthread_t readers[MAX_READERS], churners[2];
+        double start, elapsed;
+
+        start = now();
+        for (i = 0; i < 2; i++)
+            pthread_create(&churners[i], NULL, churn_thread, NULL);
+        for (i = 0; i < num_readers; i++)
+            pthread_create(&readers[i], NULL, reader_thread, NULL);
+        for (i = 0; i < num_readers; i++)
+            pthread_join(readers[i], NULL);
+        elapsed = now() - start;
+        for (i = 0; i < 2; i++)
+            pthread_join(churners[i], NULL);
+
+        printf("%s heap, %d reader%s: %7.1f M lookups/s\n",
+               flags & OBJECT_HEAP_FLAT ? "flat    " : "bucketed",
+               num_readers, num_readers > 1 ? "s" : " ",
+               (double) num_readers * NUM_LOOKUPS / elapsed / 1e6);
+    }
+
+    count = 0;
+    for (obj = object_heap_first(&heap, &iter); obj; obj = object_heap_next(&heap, &iter))
+        count++;
+    CHECK(count == NUM_STABLE);
+
+    for (i = 0; i < NUM_STABLE; i++)
+        object_heap_free(&heap, object_heap_lookup(&heap, stable_ids[i]));
+    object_heap_destroy(&heap);
+    return 0;
+}
+
+int
+main(void)
+{
+    if (check_capacity(0) || check_capacity(OBJECT_HEAP_FLAT | OBJECT_HEAP_CACHE_ALIGNED))
+        return 1;
+    if (run(0) || run(OBJECT_HEAP_FLAT | OBJECT_HEAP_CACHE_ALIGNED))
+        return 1;
+    return failed ? 1 : 0;
+}